@@ -1,37 +1,324 @@
 #include "whisper.h"
 #include "common-whisper.h"
+#include "audio-stream.h"
+#include "media-cache.h"
+#include "transcript.h"
+#include "word-index.h"
+#include "transcribe-pool.h"
+#include "vad-stream.h"
+#include "bounded-queue.h"
+#include "keyword-decode.h"
+#include "cleaned-vocab.h"
+#include "word-matcher.h"
+#include "fuzzy-match.h"
 
 extern "C" {
 #include <libavutil/log.h>
 }
 
+#include <deque>
+#include <fstream>
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
+#include <cstdlib>
 #include <thread>
+#include <chrono>
 
-std::string clean_word(const std::string & word) {
-    std::string cleaned;
-    cleaned.reserve(word.length());
-    for (unsigned char c : word) {
-        if (std::isalnum(c)) {
-            cleaned += (char)std::tolower(c);
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+enum detect_mode {
+    DETECT_MODE_SEARCH,      // <audio_file> <word>
+    DETECT_MODE_BUILD_INDEX, // --build-index <dir> <index_file>
+    DETECT_MODE_QUERY,       // --query <index_file> <word>
+};
+
+struct detect_params {
+    detect_mode mode = DETECT_MODE_SEARCH;
+
+    std::string audio_file;
+    std::string corpus_dir;
+    std::string index_file;
+    std::string target_word;
+    std::vector<std::string> words; // several cleaned words, searched for in a single pass
+    bool all_occurrences = false;   // report every occurrence of each of the words, not only the first
+    int  max_edits = 0;             // words match within this many insertions, deletions or substitutions
+    std::string output_file    = "/tmp/trim-output.opus";
+    std::string model_path     = "/home/daniel/archivos/ggml-large-v3-turbo-q5_0.bin";
+    std::string vad_model_path = "/home/daniel/archivos/ggml-silero-v6.2.0.bin";
+    std::string screen_model_path; // small model screening speech for --model to confirm
+
+    int n_threads     = std::thread::hardware_concurrency();
+    int n_vad_threads = 1; // taken from n_threads, the VAD runs on its own pipeline stage
+    int n_processors  = 1; // whisper states transcribing speech segments in parallel
+    int beam_size    = 5;
+    std::string language = "auto";
+    bool pin_language = false; // detect the language once per file instead of on every segment
+    int n_lookahead  = 2; // 30 s chunks transcribed ahead of the oldest unfinished one
+    bool pack        = true; // concatenate short speech segments into 30 s whisper windows
+    bool adaptive_audio_ctx = false; // size the encoder context to each job
+    float keyword_boost = 0.0f;      // > 0: greedy decoding with the target's tokens boosted by this logit
+    float screen_threshold = 0.75f;  // similarity() to the target that sends a screened job to --model
+    float adaptive_beam = 0.0f;      // > 0: greedy first, beam search for segments with an average token probability below this
+    float escalate_similarity = 0.75f; // similarity() to the target of a near miss that --adaptive-beam decodes again
+    bool  forced_align = false;       // score the target by forced alignment instead of transcribing
+    float align_threshold = -2.0f;    // alignment score flagging a window, 0 is the decoder's own choice
+
+    double t_from = 0.0;
+    double t_to   = -1.0;
+
+    std::string pcm_cache_dir;
+    std::string transcript_cache_dir;
+
+    bool print_stats = false;
+};
+
+// Append the cleaned words of fname to words, one per line. Lines without alphanumeric characters are skipped
+bool read_words_file(const std::string & fname, std::vector<std::string> & words) {
+    std::ifstream file(fname);
+    if (!file) {
+        fprintf(stderr, "Error: Failed to open words file %s\n", fname.c_str());
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        const std::string word = clean_word(line);
+        if (!word.empty()) {
+            words.push_back(word);
+        }
+    }
+
+    return true;
+}
+
+// parse "ss[.ms]", "mm:ss[.ms]" or "hh:mm:ss[.ms]" into seconds, returns -1 on error
+double parse_time(const std::string & str) {
+    double seconds = 0.0;
+    size_t start = 0;
+    while (true) {
+        size_t end = str.find(':', start);
+        std::string part = str.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        char * parsed_end = nullptr;
+        double value = std::strtod(part.c_str(), &parsed_end);
+        if (part.empty() || *parsed_end != '\0' || value < 0) {
+            return -1.0;
         }
+        seconds = seconds * 60.0 + value;
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
     }
-    return cleaned;
+    return seconds;
+}
+
+void print_usage(const char * argv0) {
+    fprintf(stderr, "Usage: %s <audio_file> <word> [options]\n", argv0);
+    fprintf(stderr, "       %s <audio_file> [<word>] [--word <word>]... [--words-file <file>] [--all-occurrences] [options]\n", argv0);
+    fprintf(stderr, "       %s --build-index <dir> <index_file> [options]\n", argv0);
+    fprintf(stderr, "       %s --query <index_file> <word> [options]\n", argv0);
+    fprintf(stderr, "Options: [--output <output_file>] [--model <path>] [--vad-model <path>] [--screen-model <path>] [--screen-threshold <similarity>] [--threads <n>] [--vad-threads <n>] [--processors <n>] [--lookahead <n>] [--no-pack] [--adaptive-audio-ctx] [--keyword-boost <logit>] [--beam-size <n>] [--max-edits <n>] [--language <lang>] [--pin-language] [--adaptive-beam <p>] [--forced-align] [--align-threshold <score>] [--escalate-similarity <similarity>] [--from <time>] [--to <time>] [--pcm-cache <dir>] [--transcript-cache <dir>] [--stats]\n");
 }
 
-void append_cleaned_word(const char * token_text, std::string & accumulated, std::vector<int> & char_to_token, int token_index) {
-    if (!token_text) return;
-    for (size_t i = 0; token_text[i] != '\0'; ++i) {
-        unsigned char c = (unsigned char)token_text[i];
-        if (std::isalnum(c)) {
-            accumulated += (char)std::tolower(c);
-            char_to_token.push_back(token_index);
+bool detect_params_parse(int argc, char ** argv, detect_params & params) {
+    const std::string mode = argc > 1 ? argv[1] : "";
+    int i_options = 3;
+    if (mode == "--build-index" && argc >= 4) {
+        params.mode       = DETECT_MODE_BUILD_INDEX;
+        params.corpus_dir = argv[2];
+        params.index_file = argv[3];
+        i_options = 4;
+    } else if (mode == "--query" && argc >= 4) {
+        params.mode        = DETECT_MODE_QUERY;
+        params.index_file  = argv[2];
+        params.target_word = clean_word(argv[3]);
+        i_options = 4;
+    } else if (argc >= 2 && mode.compare(0, 2, "--") != 0) {
+        params.audio_file = argv[1];
+        if (argc >= 3 && std::string(argv[2]).compare(0, 2, "--") != 0) {
+            params.target_word = clean_word(argv[2]);
+            if (params.target_word.empty()) {
+                fprintf(stderr, "Error: The word has no alphanumeric characters\n");
+                return false;
+            }
+        } else {
+            i_options = 2;
         }
+    } else {
+        print_usage(argv[0]);
+        return false;
+    }
+
+    for (int i = i_options; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            params.output_file = argv[++i];
+        } else if (arg == "--model" && i + 1 < argc) {
+            params.model_path = argv[++i];
+        } else if (arg == "--vad-model" && i + 1 < argc) {
+            params.vad_model_path = argv[++i];
+        } else if (arg == "--screen-model" && i + 1 < argc) {
+            params.screen_model_path = argv[++i];
+        } else if (arg == "--screen-threshold" && i + 1 < argc) {
+            params.screen_threshold = std::stof(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            params.n_threads = std::stoi(argv[++i]);
+        } else if (arg == "--vad-threads" && i + 1 < argc) {
+            params.n_vad_threads = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--word" && i + 1 < argc) {
+            params.words.push_back(clean_word(argv[++i]));
+            if (params.words.back().empty()) {
+                fprintf(stderr, "Error: The word '%s' has no alphanumeric characters\n", argv[i]);
+                return false;
+            }
+        } else if (arg == "--words-file" && i + 1 < argc) {
+            if (!read_words_file(argv[++i], params.words)) {
+                return false;
+            }
+        } else if (arg == "--max-edits" && i + 1 < argc) {
+            params.max_edits = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--all-occurrences") {
+            params.all_occurrences = true;
+        } else if (arg == "--keyword-boost" && i + 1 < argc) {
+            params.keyword_boost = std::stof(argv[++i]);
+        } else if (arg == "--adaptive-audio-ctx") {
+            params.adaptive_audio_ctx = true;
+        } else if (arg == "--no-pack") {
+            params.pack = false;
+        } else if (arg == "--stats") {
+            params.print_stats = true;
+        } else if (arg == "--processors" && i + 1 < argc) {
+            params.n_processors = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--lookahead" && i + 1 < argc) {
+            params.n_lookahead = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--beam-size" && i + 1 < argc) {
+            params.beam_size = std::stoi(argv[++i]);
+        } else if (arg == "--language" && i + 1 < argc) {
+            params.language = argv[++i];
+            if (params.language != "auto" && whisper_lang_id(params.language.c_str()) < 0) {
+                fprintf(stderr, "Error: Unknown language '%s'\n", argv[i]);
+                return false;
+            }
+        } else if (arg == "--pin-language") {
+            params.pin_language = true;
+        } else if (arg == "--forced-align") {
+            params.forced_align = true;
+        } else if (arg == "--align-threshold" && i + 1 < argc) {
+            params.align_threshold = std::stof(argv[++i]);
+        } else if (arg == "--adaptive-beam" && i + 1 < argc) {
+            params.adaptive_beam = std::stof(argv[++i]);
+        } else if (arg == "--escalate-similarity" && i + 1 < argc) {
+            params.escalate_similarity = std::stof(argv[++i]);
+        } else if (arg == "--pcm-cache" && i + 1 < argc) {
+            params.pcm_cache_dir = argv[++i];
+        } else if (arg == "--transcript-cache" && i + 1 < argc) {
+            params.transcript_cache_dir = argv[++i];
+        } else if (arg == "--from" && i + 1 < argc) {
+            params.t_from = parse_time(argv[++i]);
+            if (params.t_from < 0) {
+                fprintf(stderr, "Error: Invalid time '%s' for --from\n", argv[i]);
+                return false;
+            }
+        } else if (arg == "--to" && i + 1 < argc) {
+            params.t_to = parse_time(argv[++i]);
+            if (params.t_to < 0) {
+                fprintf(stderr, "Error: Invalid time '%s' for --to\n", argv[i]);
+                return false;
+            }
+        }
+    }
+
+    // a single word takes the single word search, which stops at its first occurrence and trims the file
+    // --word, --words-file and --all-occurrences take the word list search, even for a single word
+    if (params.mode == DETECT_MODE_SEARCH && (!params.words.empty() || params.all_occurrences)) {
+        std::vector<std::string> words;
+        if (!params.target_word.empty()) {
+            words.push_back(params.target_word);
+        }
+        for (const std::string & word : params.words) {
+            if (std::find(words.begin(), words.end(), word) == words.end()) {
+                words.push_back(word);
+            }
+        }
+        params.words = words;
+        params.target_word.clear();
+    }
+
+    if (params.mode == DETECT_MODE_SEARCH && params.target_word.empty() && params.words.empty()) {
+        fprintf(stderr, "Error: No word to search for\n");
+        return false;
+    }
+    if (params.mode == DETECT_MODE_QUERY && params.target_word.empty()) {
+        fprintf(stderr, "Error: The word has no alphanumeric characters\n");
+        return false;
+    }
+
+    if (params.max_edits > 0) {
+        std::vector<std::string> words = params.words;
+        if (!params.target_word.empty()) {
+            words.push_back(params.target_word);
+        }
+        for (const std::string & word : words) {
+            fuzzy_matcher matcher;
+            if (!matcher.init(word, params.max_edits)) {
+                fprintf(stderr, "Error: --max-edits %d needs words of %d to 64 characters, '%s' has %zu\n",
+                        params.max_edits, params.max_edits + 1, word.c_str(), word.size());
+                return false;
+            }
+        }
+    }
+
+    if (params.t_to >= 0 && params.t_to <= params.t_from) {
+        fprintf(stderr, "Error: --to must be after --from\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Decoding is biased towards the target word, so the transcript only serves searches for that word
+bool use_keyword_boost(const detect_params & params) {
+    return params.keyword_boost > 0 && !params.target_word.empty();
+}
+
+// Speech is screened by the small model for the target, the transcript only serves searches for that word
+bool use_screen_model(const detect_params & params) {
+    return !params.screen_model_path.empty() && !params.target_word.empty();
+}
+
+// Speech is scored for the target without being transcribed, so there is no transcript to cache
+bool use_forced_align(const detect_params & params) {
+    return params.forced_align && !params.target_word.empty();
+}
+
+// identifies the decoding setup a cached transcript was made with
+std::string transcript_config(const detect_params & params) {
+    std::string config = params.model_path + ";beam_size=" + std::to_string(params.beam_size) + (params.pack ? ";pack" : "") +
+        (params.adaptive_audio_ctx ? ";adaptive_audio_ctx" : "");
+    if (use_keyword_boost(params)) {
+        config += ";keyword_boost=" + std::to_string(params.keyword_boost) + ":" + params.target_word;
+    }
+    if (params.language != "auto") {
+        config += ";language=" + params.language;
+    } else if (params.pin_language) {
+        config += ";pin_language";
+    }
+    if (params.adaptive_beam > 0 && !use_keyword_boost(params)) {
+        config += ";adaptive_beam=" + std::to_string(params.adaptive_beam);
+        if (!params.target_word.empty()) {
+            config += ":" + std::to_string(params.escalate_similarity) + ":" + params.target_word;
+        }
+    }
+    if (use_screen_model(params)) {
+        config += ";screen=" + params.screen_model_path + ":" + std::to_string(params.screen_threshold) + ":" + params.target_word;
     }
+    return config;
 }
 
 void whisper_log_callback(ggml_log_level level, const char * text, void * user_data) {
@@ -45,167 +332,702 @@ void whisper_log_callback(ggml_log_level level, const char * text, void * user_d
     }
 }
 
-int main(int argc, char ** argv) {
-    whisper_log_set(whisper_log_callback, nullptr);
-    av_log_set_level(AV_LOG_ERROR);
+// Pipeline counters over all scans of a run, printed with --stats
+struct detect_stats {
+    double   audio_s         = 0.0; // audio scanned
+    double   scan_s          = 0.0; // wall time of the scans
+    transcribe_pool_stats pool;
 
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <audio_file> <word> [--output <output_file>] [--model <path>] [--vad-model <path>] [--threads <n>] [--beam-size <n>]\n", argv[0]);
-        return 1;
+    double   vad_busy_s      = 0.0; // VAD stage running the model
+    double   vad_wait_s      = 0.0; // VAD stage blocked because transcription is behind
+    double   asr_wait_s      = 0.0; // transcription stage idle waiting for speech segments
+    bounded_queue_stats queue;      // depth of the segment queue
+};
+
+void detect_stats_print(const detect_stats & stats) {
+    fprintf(stderr, "Scanned %.2f s of audio in %.2f s, RTF %.4f\n", stats.audio_s, stats.scan_s, stats.audio_s > 0 ? stats.scan_s / stats.audio_s : 0.0);
+    fprintf(stderr, "Whisper: %llu jobs in %.2f s, %llu rerun at full context, %llu of %llu encoder frames (%.1f%%)\n",
+            (unsigned long long) stats.pool.n_jobs, stats.pool.t_whisper_s, (unsigned long long) stats.pool.n_reruns,
+            (unsigned long long) stats.pool.n_frames, (unsigned long long) stats.pool.n_frames_full,
+            stats.pool.n_frames_full > 0 ? 100.0 * stats.pool.n_frames / stats.pool.n_frames_full : 0.0);
+    if (stats.pool.n_lang_detect > 0) {
+        fprintf(stderr, "Language: detected on %llu jobs in %.2f s, pinned for %llu jobs\n",
+                (unsigned long long) stats.pool.n_lang_detect, stats.pool.t_lang_detect_s, (unsigned long long) stats.pool.n_lang_pinned);
+    }
+    if (stats.pool.n_align_decode > 0) {
+        fprintf(stderr, "Forced alignment: %llu decoder calls, %.1f per job\n",
+                (unsigned long long) stats.pool.n_align_decode, stats.pool.n_jobs > 0 ? (double) stats.pool.n_align_decode / stats.pool.n_jobs : 0.0);
+    }
+    if (stats.pool.n_greedy > 0) {
+        fprintf(stderr, "Adaptive beam: %llu of %llu jobs (%.1f%%) escalated to beam search\n",
+                (unsigned long long) stats.pool.n_escalated, (unsigned long long) stats.pool.n_greedy,
+                100.0 * stats.pool.n_escalated / stats.pool.n_greedy);
+    }
+    if (stats.pool.n_screened > 0) {
+        fprintf(stderr, "Screening: %llu jobs in %.2f s, %llu (%.1f%%) confirmed by the main model\n",
+                (unsigned long long) stats.pool.n_screened, stats.pool.t_screen_s, (unsigned long long) stats.pool.n_confirmed,
+                100.0 * stats.pool.n_confirmed / stats.pool.n_screened);
     }
+    fprintf(stderr, "VAD: %.2f s busy, %.2f s waiting for transcription\n", stats.vad_busy_s, stats.vad_wait_s);
+    fprintf(stderr, "Transcription: %.2f s waiting for VAD\n", stats.asr_wait_s);
+    fprintf(stderr, "Segment queue: depth avg %.2f, max %zu\n", stats.queue.avg_depth(), stats.queue.max_depth);
+}
 
-    std::string audio_file = argv[1];
-    std::string target_word = clean_word(argv[2]);
-    std::string output_file = "/tmp/trim-output.opus";
-    std::string model_path = "/home/daniel/archivos/ggml-large-v3-turbo-q5_0.bin";
-    std::string vad_model_path = "/home/daniel/archivos/ggml-silero-v6.2.0.bin";
-    int n_threads = std::thread::hardware_concurrency();
-    int beam_size = 5;
+// Models shared by all scans of a run, loaded on first use so that indexing a corpus loads them only once
+// The whisper model is loaded once, each of the --processors states only adds its own buffers
+struct detect_context {
+    struct whisper_vad_context * vctx = nullptr;
+    struct whisper_context     * ctx  = nullptr;
+    std::vector<struct whisper_state *> states;
+    cleaned_vocab vocab; // cleaned text of every token of ctx, built once per run
 
-    for (int i = 3; i < argc; ++i) {
-        std::string arg = argv[i];
-        if (arg == "--output" && i + 1 < argc) {
-            output_file = argv[++i];
-        } else if (arg == "--model" && i + 1 < argc) {
-            model_path = argv[++i];
-        } else if (arg == "--vad-model" && i + 1 < argc) {
-            vad_model_path = argv[++i];
-        } else if (arg == "--threads" && i + 1 < argc) {
-            n_threads = std::stoi(argv[++i]);
-        } else if (arg == "--beam-size" && i + 1 < argc) {
-            beam_size = std::stoi(argv[++i]);
+    struct whisper_context     * screen_ctx = nullptr; // --screen-model, with a state per processor
+    std::vector<struct whisper_state *> screen_states;
+    cleaned_vocab screen_vocab;
+
+    detect_stats stats;
+};
+
+// Speech found by the VAD stage in one decoded chunk
+struct vad_chunk {
+    std::vector<speech_segment> speech;
+    int64_t position = 0; // all speech before this absolute sample position has been emitted
+};
+
+bool detect_context_init(const detect_params & params, detect_context & dctx) {
+    if (dctx.vctx == nullptr) {
+        struct whisper_vad_context_params vparams = whisper_vad_default_context_params();
+        vparams.n_threads = params.n_vad_threads;
+        dctx.vctx = whisper_vad_init_from_file_with_params(params.vad_model_path.c_str(), vparams);
+        if (dctx.vctx == nullptr) {
+            fprintf(stderr, "Error: Failed to initialize VAD context from %s\n", params.vad_model_path.c_str());
+            return false;
         }
     }
 
-    // Load audio data
-    std::vector<float> pcmf32;
-    std::vector<std::vector<float>> pcmf32s;
-    if (!read_audio_data(audio_file, pcmf32, pcmf32s, false)) {
-        fprintf(stderr, "Error: Failed to read audio data from %s\n", audio_file.c_str());
-        return 1;
+    if (dctx.ctx == nullptr) {
+        struct whisper_context_params cparams = whisper_context_default_params();
+        dctx.ctx = whisper_init_from_file_with_params_no_state(params.model_path.c_str(), cparams);
+        if (dctx.ctx == nullptr) {
+            fprintf(stderr, "Error: Failed to initialize whisper context from %s\n", params.model_path.c_str());
+            return false;
+        }
+        dctx.vocab.init(dctx.ctx);
     }
 
-    // Initialize VAD context
-    struct whisper_vad_context_params vparams = whisper_vad_default_context_params();
-    vparams.n_threads = n_threads;
-    struct whisper_vad_context * vctx = whisper_vad_init_from_file_with_params(vad_model_path.c_str(), vparams);
-    if (vctx == nullptr) {
-        fprintf(stderr, "Error: Failed to initialize VAD context from %s\n", vad_model_path.c_str());
-        return 1;
+    while ((int) dctx.states.size() < params.n_processors) {
+        struct whisper_state * state = whisper_init_state(dctx.ctx);
+        if (state == nullptr) {
+            fprintf(stderr, "Error: Failed to initialize whisper state %zu\n", dctx.states.size());
+            return false;
+        }
+        dctx.states.push_back(state);
     }
 
-    // Initialize whisper context
-    struct whisper_context_params cparams = whisper_context_default_params();
-    struct whisper_context * ctx = whisper_init_from_file_with_params(model_path.c_str(), cparams);
-    if (ctx == nullptr) {
-        fprintf(stderr, "Error: Failed to initialize whisper context from %s\n", model_path.c_str());
-        whisper_vad_free(vctx);
-        return 1;
+    if (use_screen_model(params)) {
+        if (dctx.screen_ctx == nullptr) {
+            struct whisper_context_params cparams = whisper_context_default_params();
+            dctx.screen_ctx = whisper_init_from_file_with_params_no_state(params.screen_model_path.c_str(), cparams);
+            if (dctx.screen_ctx == nullptr) {
+                fprintf(stderr, "Error: Failed to initialize whisper context from %s\n", params.screen_model_path.c_str());
+                return false;
+            }
+            dctx.screen_vocab.init(dctx.screen_ctx);
+        }
+        while ((int) dctx.screen_states.size() < params.n_processors) {
+            struct whisper_state * state = whisper_init_state(dctx.screen_ctx);
+            if (state == nullptr) {
+                fprintf(stderr, "Error: Failed to initialize screening state %zu\n", dctx.screen_states.size());
+                return false;
+            }
+            dctx.screen_states.push_back(state);
+        }
     }
 
-    whisper_full_params params = whisper_full_default_params(WHISPER_SAMPLING_BEAM_SEARCH);
-    params.beam_search.beam_size = beam_size;
-    params.print_progress = false;
-    params.print_special = false;
-    params.print_realtime = false;
-    params.print_timestamps = false;
-    params.translate = false;
-    params.language = "auto";
-    params.n_threads = n_threads;
-    params.token_timestamps = true;
-    params.no_context = true;
-    params.single_segment = false;
-    params.suppress_blank = true;
-    params.suppress_nst = true;
+    return true;
+}
 
-    float final_start_seconds = -1.0f;
+void detect_context_free(detect_context & dctx) {
+    for (struct whisper_state * state : dctx.states) {
+        whisper_free_state(state);
+    }
+    for (struct whisper_state * state : dctx.screen_states) {
+        whisper_free_state(state);
+    }
+    if (dctx.screen_ctx) {
+        whisper_free(dctx.screen_ctx);
+    }
+    if (dctx.vctx) {
+        whisper_vad_free(dctx.vctx);
+    }
+    if (dctx.ctx) {
+        whisper_free(dctx.ctx);
+    }
+    dctx = detect_context();
+}
 
-    std::string accumulated_cleaned;
-    std::vector<int> char_to_token;
-    accumulated_cleaned.reserve(256);
-    char_to_token.reserve(256);
+// Transcribe the audio from t_from to params.t_to and stop at the first occurrence of the target word
+// t_found is set to its absolute start time, or -1 if it was not found
+// If record is not null every transcribed segment is appended to it and its coverage is updated,
+// the search then still stops at the first occurrence. An empty target word transcribes the whole window.
+// Returns false on error
+bool scan_audio(const detect_params & params, detect_context & dctx, double t_from, float & t_found, transcript * record) {
+    t_found = -1.0f;
+    const auto t_scan_start = std::chrono::steady_clock::now();
 
-    // Detect speech segments and process in 30s chunks
-    struct whisper_vad_params vad_params = whisper_vad_default_params();
+    // Decode audio in the background, the detection loop consumes it chunk by chunk
+    // Only the [t_from, t_to) window is decoded, the decoder seeks to its start
+    // With --pcm-cache a cached decode is streamed instead, a cache miss decodes the whole file once to fill it
     const int chunk_size_samples = 30 * WHISPER_SAMPLE_RATE;
-
-    for (int i = 0; i < (int)pcmf32.size(); i += chunk_size_samples) {
-        int n_samples = std::min(chunk_size_samples, (int)pcmf32.size() - i);
-        struct whisper_vad_segments * segments = whisper_vad_segments_from_samples(vctx, vad_params, pcmf32.data() + i, n_samples);
-        if (segments == nullptr) {
-            continue;
+    audio_ring_buffer ring(4 * chunk_size_samples);
+    bool decode_ok = true;
+    std::thread decoder([&]() {
+        if (params.pcm_cache_dir.empty()) {
+            decode_ok = read_audio_data_stream(params.audio_file, ring, t_from, params.t_to);
+        } else {
+            decode_ok = read_audio_data_cached(params.audio_file, params.pcm_cache_dir, ring, t_from, params.t_to);
         }
+    });
+
+    // Load the models while the first chunk is decoded
+    if (!detect_context_init(params, dctx)) {
+        ring.cancel();
+        decoder.join();
+        return false;
+    }
+    // With --keyword-boost greedy decoding is biased towards the target instead of searching wider beams
+    keyword_boost kb;
+    const bool boost = use_keyword_boost(params) && keyword_boost_init(dctx.ctx, params.target_word, params.keyword_boost, kb);
 
-        int n_vad_segments = whisper_vad_segments_n_segments(segments);
-        for (int j = 0; j < n_vad_segments; ++j) {
-            float t0_local = whisper_vad_segments_get_segment_t0(segments, j) * 0.01f;
-            float t1_local = whisper_vad_segments_get_segment_t1(segments, j) * 0.01f;
-            
-            float t0 = (float)i / (float)WHISPER_SAMPLE_RATE + t0_local;
-            float t1 = (float)i / (float)WHISPER_SAMPLE_RATE + t1_local;
+    whisper_full_params wparams = whisper_full_default_params(boost ? WHISPER_SAMPLING_GREEDY : WHISPER_SAMPLING_BEAM_SEARCH);
+    wparams.beam_search.beam_size = params.beam_size;
+    if (boost) {
+        wparams.logits_filter_callback           = keyword_boost_logits_filter;
+        wparams.logits_filter_callback_user_data = &kb;
+    }
+    // The target is found in whisper output by token id, a word too long for a table is matched in the cleaned text
+    token_matcher matcher;
+    const bool use_matcher = !params.target_word.empty() && matcher.init(dctx.vocab, params.target_word);
 
-            int sample_start = (int)(t0 * WHISPER_SAMPLE_RATE);
-            int sample_count = (int)((t1 - t0) * WHISPER_SAMPLE_RATE);
+    wparams.print_progress = false;
+    wparams.print_special = false;
+    wparams.print_realtime = false;
+    wparams.print_timestamps = false;
+    wparams.translate = false;
+    wparams.language = params.language.c_str();
+    wparams.n_threads = std::max(1, params.n_threads - params.n_vad_threads);
+    wparams.token_timestamps = true;
+    wparams.no_context = true;
+    wparams.single_segment = false;
+    wparams.suppress_blank = true;
+    wparams.suppress_nst = true;
 
-            if (sample_start >= (int)pcmf32.size()) continue;
-            if (sample_start + sample_count > (int)pcmf32.size()) {
-                sample_count = (int)pcmf32.size() - sample_start;
-            }
-            if (sample_count <= 0) continue;
+    // Speech segments are transcribed in parallel and handed back in time order
+    transcribe_pool pool;
+    transcribe_pool_params pool_params;
+    pool_params.wparams            = wparams;
+    pool_params.target             = params.target_word;
+    pool_params.vocab              = &dctx.vocab;
+    pool_params.matcher            = use_matcher ? &matcher : nullptr;
+    fuzzy_matcher fuzzy;
+    if (params.max_edits > 0 && fuzzy.init(params.target_word, params.max_edits)) {
+        pool_params.fuzzy = &fuzzy;
+    }
+    pool_params.n_threads          = wparams.n_threads;
+    pool_params.adaptive_audio_ctx = params.adaptive_audio_ctx;
+    pool_params.pin_language        = params.pin_language && params.language == "auto";
+    pool_params.escalate_p          = params.adaptive_beam;
+    keyword_align ka;
+    if (use_forced_align(params) && keyword_align_init(dctx.ctx, params.target_word, params.align_threshold, ka)) {
+        pool_params.align = &ka;
+    }
+    pool_params.escalate_similarity = params.escalate_similarity;
+    if (use_screen_model(params)) {
+        // screening is plain greedy decoding, the decoding aids above only apply to the main model
+        pool_params.screen_ctx       = dctx.screen_ctx;
+        pool_params.screen_vocab     = &dctx.screen_vocab;
+        pool_params.screen_threshold = params.screen_threshold;
+        pool_params.screen_wparams   = wparams;
+        pool_params.screen_wparams.strategy               = WHISPER_SAMPLING_GREEDY;
+        pool_params.screen_wparams.logits_filter_callback = nullptr;
+    }
+    pool.start(dctx.ctx, dctx.states, pool_params, dctx.screen_states);
 
-            if (whisper_full(ctx, params, pcmf32.data() + sample_start, sample_count) != 0) {
-                fprintf(stderr, "Error: Failed to process segment.\n");
-                continue;
-            }
+    // Chunks whose segments are still being transcribed: (number of jobs submitted up to the chunk, end of the audio they cover)
+    // Up to --lookahead chunks are transcribed ahead of the oldest unfinished one
+    std::deque<std::pair<int64_t, double>> pending;
+    int64_t n_submitted = 0;
+    int64_t n_committed = 0;
+    transcribe_job job;
 
-            const int n_whisper_segments = whisper_full_n_segments(ctx);
-            for (int k = 0; k < n_whisper_segments; ++k) {
-                accumulated_cleaned.clear();
-                char_to_token.clear();
-                const int n_tokens = whisper_full_n_tokens(ctx, k);
-                
-                for (int l = 0; l < n_tokens; ++l) {
-                    whisper_token token_id = whisper_full_get_token_id(ctx, k, l);
-                    if (token_id >= whisper_token_beg(ctx)) continue;
+    // A job whisper failed on leaves a gap in the transcript: the record's coverage stops at the start of
+    // the job, so that the gap is transcribed again instead of being cached as searched. The segments after
+    // it are still recorded for searching, they are just not cached
+    bool record_gap = false;
 
-                    const char * token_text = whisper_full_get_token_text(ctx, k, l);
-                    append_cleaned_word(token_text, accumulated_cleaned, char_to_token, l);
+    // Commit finished jobs in time order, the first hit is the first occurrence
+    // Blocks while more than max_pending chunks are unfinished
+    auto commit = [&](size_t max_pending) {
+        while (t_found < 0) {
+            while (!pending.empty() && pending.front().first <= n_committed) {
+                if (record && !record_gap) {
+                    record->t_end = pending.front().second;
                 }
+                pending.pop_front();
+            }
+            if (pending.empty() || (pending.size() <= max_pending && !pool.ready()) || !pool.next(job)) {
+                break;
+            }
+            ++n_committed;
 
-                size_t pos = accumulated_cleaned.find(target_word);
-                if (pos != std::string::npos) {
-                    int token_index = char_to_token[pos];
-                    whisper_token_data token_data = whisper_full_get_token_data(ctx, k, token_index);
-                    
-                    final_start_seconds = t0 + (token_data.t0 * 0.01f);
-                    break;
+            if (record && !record_gap && !job.ok) {
+                record->n_before_gap = record->segments.size();
+            }
+            record_gap = record_gap || !job.ok;
+            if (record) {
+                for (transcript_segment & segment : job.segments) {
+                    record->segments.push_back(std::move(segment));
+                }
+            }
+            if (job.t_found >= 0) {
+                t_found = (float) job.t_found;
+                if (record && !record_gap) {
+                    record->t_end = job.t_end;
                 }
+                pool.cancel();
             }
-            if (final_start_seconds >= 0) break;
         }
+    };
+
+    // The VAD stage runs ahead on its own thread and detects speech in 30s chunks as they are decoded
+    // Speech running into the end of a chunk is held back by the VAD until it ends, so segments have no seams
+    const int64_t window_start = (int64_t)(t_from * WHISPER_SAMPLE_RATE);
+    bounded_queue<vad_chunk> vad_queue(params.n_lookahead + 2);
+    int64_t n_samples_total = 0;
+    double vad_busy_s = 0.0;
+    std::thread vad_thread([&]() {
+        vad_stream vad(dctx.vctx, whisper_vad_default_params(), window_start);
+        std::vector<float> pcmf32(chunk_size_samples);
+        while (true) {
+            const size_t n_samples = ring.pop(pcmf32.data(), chunk_size_samples);
+            n_samples_total += n_samples;
+
+            const auto t_start = std::chrono::steady_clock::now();
+            vad_chunk chunk;
+            if (n_samples > 0) {
+                vad.push(pcmf32.data(), n_samples, chunk.speech);
+                chunk.position = vad.position();
+            } else {
+                vad.flush(chunk.speech);
+                chunk.position = window_start + n_samples_total;
+            }
+            vad_busy_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+            if (!vad_queue.push(std::move(chunk)) || n_samples == 0) {
+                break;
+            }
+        }
+        vad_queue.close();
+    });
+
+    // The transcription stage packs the speech of each chunk into jobs of up to 30s and submits them to the pool
+    transcribe_packer packer(params.pack ? chunk_size_samples : 0);
+    transcribe_job packed;
+    vad_chunk chunk;
+    int64_t position = window_start;
+    while (t_found < 0 && vad_queue.pop(chunk)) {
+        for (speech_segment & segment : chunk.speech) {
+            if (packer.add(std::move(segment), packed)) {
+                pool.submit(std::move(packed));
+                ++n_submitted;
+            }
+            if (!params.pack && packer.flush(packed)) {
+                pool.submit(std::move(packed));
+                ++n_submitted;
+            }
+        }
+        if (packer.flush_stale(chunk.position, packed)) {
+            pool.submit(std::move(packed));
+            ++n_submitted;
+        }
+
+        // the chunk is covered up to the speech held back by the VAD or the packer
+        position = std::min(chunk.position, packer.pending_start());
+        pending.emplace_back(n_submitted, (double) position / WHISPER_SAMPLE_RATE);
+        commit(params.n_lookahead);
+    }
+    if (t_found < 0 && packer.flush(packed)) {
+        pool.submit(std::move(packed));
+        ++n_submitted;
+        pending.emplace_back(n_submitted, (double) std::max(position, chunk.position) / WHISPER_SAMPLE_RATE);
+    }
+    commit(0);
+
+    // Stop decoding audio past the detected word (a --pcm-cache fill still runs to the end of the file)
+    pool.stop();
+    vad_queue.cancel();
+    ring.cancel();
+    vad_thread.join();
+    decoder.join();
+
+    const bounded_queue_stats   queue_stats = vad_queue.get_stats();
+    const transcribe_pool_stats pool_stats  = pool.get_stats();
+    dctx.stats.audio_s += (double) n_samples_total / WHISPER_SAMPLE_RATE;
+    dctx.stats.scan_s  += std::chrono::duration<double>(std::chrono::steady_clock::now() - t_scan_start).count();
+    dctx.stats.pool.n_jobs        += pool_stats.n_jobs;
+    dctx.stats.pool.n_reruns      += pool_stats.n_reruns;
+    dctx.stats.pool.n_frames      += pool_stats.n_frames;
+    dctx.stats.pool.n_frames_full += pool_stats.n_frames_full;
+    dctx.stats.pool.t_whisper_s   += pool_stats.t_whisper_s;
+    dctx.stats.pool.n_lang_detect   += pool_stats.n_lang_detect;
+    dctx.stats.pool.n_lang_pinned   += pool_stats.n_lang_pinned;
+    dctx.stats.pool.t_lang_detect_s += pool_stats.t_lang_detect_s;
+    dctx.stats.pool.n_align_decode  += pool_stats.n_align_decode;
+    dctx.stats.pool.n_greedy      += pool_stats.n_greedy;
+    dctx.stats.pool.n_escalated   += pool_stats.n_escalated;
+    dctx.stats.pool.n_screened    += pool_stats.n_screened;
+    dctx.stats.pool.n_confirmed   += pool_stats.n_confirmed;
+    dctx.stats.pool.t_screen_s    += pool_stats.t_screen_s;
+    dctx.stats.vad_busy_s      += vad_busy_s;
+    dctx.stats.vad_wait_s      += queue_stats.push_wait_s;
+    dctx.stats.asr_wait_s      += queue_stats.pop_wait_s;
+    dctx.stats.queue.max_depth  = std::max(dctx.stats.queue.max_depth, queue_stats.max_depth);
+    dctx.stats.queue.n_pushed  += queue_stats.n_pushed;
+    dctx.stats.queue.depth_sum += queue_stats.depth_sum;
 
-        whisper_vad_free_segments(segments);
-        if (final_start_seconds >= 0) break;
+    // every job run with the pinned language skips a detection, estimated at the average cost of one
+    if (params.print_stats && pool_stats.n_lang_detect > 0) {
+        const int lang = pool.pinned_language();
+        const double t_detect = pool_stats.n_lang_detect > 0 ? pool_stats.t_lang_detect_s / pool_stats.n_lang_detect : 0.0;
+        fprintf(stderr, "Language of %s: %s after %llu detections, about %.2f s saved on %llu jobs\n", params.audio_file.c_str(),
+                lang >= 0 ? whisper_lang_str(lang) : "not pinned", (unsigned long long) pool_stats.n_lang_detect,
+                t_detect * pool_stats.n_lang_pinned, (unsigned long long) pool_stats.n_lang_pinned);
     }
 
-    whisper_vad_free(vctx);
-    whisper_free(ctx);
+    if (!decode_ok && n_samples_total == 0) {
+        fprintf(stderr, "Error: Failed to read audio data from %s\n", params.audio_file.c_str());
+        return false;
+    }
 
-    if (final_start_seconds < 0) {
-        fprintf(stderr, "Target word '%s' not detected. Not creating an output file.\n", target_word.c_str());
-        return 0;
+    // the stream ended before the end of the window: the rest of the file is covered too
+    if (record && decode_ok && !record_gap && t_found < 0) {
+        const int64_t window_end = params.t_to >= 0 ? (int64_t)(params.t_to * WHISPER_SAMPLE_RATE) : INT64_MAX;
+        record->complete = window_start + n_samples_total + WHISPER_SAMPLE_RATE / 100 < window_end;
     }
 
-    fprintf(stderr, "Detected target word '%s' at %.3f seconds.\n", target_word.c_str(), final_start_seconds);
+    return true;
+}
 
-    std::string trim_cmd = "ffmpeg -hide_banner -loglevel error -nostdin -y -i \"" + audio_file + "\" -ss " + std::to_string(final_start_seconds) + " -c copy \"" + output_file + "\"";
+// Cut audio_file from t_start on into output_file, without re-encoding
+bool trim_audio(const std::string & audio_file, float t_start, const std::string & output_file) {
+    std::string trim_cmd = "ffmpeg -hide_banner -loglevel error -nostdin -y -i \"" + audio_file + "\" -ss " + std::to_string(t_start) + " -c copy \"" + output_file + "\"";
     fprintf(stderr, "Trimming audio and saving to %s...\n", output_file.c_str());
     if (system(trim_cmd.c_str()) != 0) {
         fprintf(stderr, "Error: Failed to trim audio using ffmpeg.\n");
-        return 1;
+        return false;
     }
 
     fprintf(stderr, "Successfully created %s.\n", output_file.c_str());
 
+    return true;
+}
+
+// Append the regular files below dir to files, recursively and in name order, hidden entries are skipped
+void list_files(const std::string & dir, std::vector<std::string> & files) {
+    DIR * d = opendir(dir.c_str());
+    if (d == nullptr) {
+        fprintf(stderr, "Warning: Failed to open directory %s\n", dir.c_str());
+        return;
+    }
+
+    std::vector<std::string> names;
+    while (struct dirent * entry = readdir(d)) {
+        if (entry->d_name[0] != '.') {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+
+    for (const std::string & name : names) {
+        const std::string path = dir + "/" + name;
+        struct stat sb;
+        if (stat(path.c_str(), &sb) != 0) {
+            continue;
+        }
+        if (S_ISDIR(sb.st_mode)) {
+            list_files(path, files);
+        } else if (S_ISREG(sb.st_mode)) {
+            files.push_back(path);
+        }
+    }
+}
+
+// Transcribe the whole of params.audio_file into tr
+// With --transcript-cache a stored transcript is reused and only the audio it doesn't cover yet is transcribed
+bool transcribe_file(const detect_params & params, detect_context & dctx, transcript & tr) {
+    detect_params file_params = params;
+    file_params.target_word.clear();
+    file_params.t_from = 0.0;
+    file_params.t_to   = -1.0;
+
+    tr = transcript();
+
+    media_file_key file_key;
+    const bool use_transcript_cache = !params.transcript_cache_dir.empty() && media_file_key_init(params.audio_file, file_key);
+    if (use_transcript_cache) {
+        transcript_cache_load(params.transcript_cache_dir, file_key, transcript_config(params), tr);
+        if (tr.complete) {
+            return true;
+        }
+    }
+
+    float t_found;
+    if (!scan_audio(file_params, dctx, tr.t_end, t_found, &tr)) {
+        return false;
+    }
+    if (use_transcript_cache) {
+        transcript_cache_save(params.transcript_cache_dir, file_key, transcript_config(params), tr);
+    }
+
+    return true;
+}
+
+// --build-index: transcribe every file below params.corpus_dir and write the word index
+// Files that can't be decoded are skipped
+int build_index(const detect_params & params) {
+    std::vector<std::string> files;
+    list_files(params.corpus_dir, files);
+
+    detect_context dctx;
+    if (!detect_context_init(params, dctx)) {
+        detect_context_free(dctx);
+        return 1;
+    }
+
+    word_index_builder builder;
+    int n_indexed = 0;
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        char resolved[PATH_MAX];
+        detect_params file_params = params;
+        file_params.audio_file = realpath(files[i].c_str(), resolved) ? resolved : files[i];
+
+        fprintf(stderr, "[%zu/%zu] Indexing %s\n", i + 1, files.size(), file_params.audio_file.c_str());
+
+        transcript tr;
+        if (!transcribe_file(file_params, dctx, tr)) {
+            fprintf(stderr, "Warning: Skipping %s\n", file_params.audio_file.c_str());
+            continue;
+        }
+        builder.add_transcript(builder.add_file(file_params.audio_file), tr);
+        ++n_indexed;
+    }
+
+    if (params.print_stats) {
+        detect_stats_print(dctx.stats);
+    }
+    detect_context_free(dctx);
+
+    if (!builder.write(params.index_file)) {
+        return 1;
+    }
+
+    fprintf(stderr, "Indexed %d of %zu files into %s.\n", n_indexed, files.size(), params.index_file.c_str());
+
+    return 0;
+}
+
+// --query: print every occurrence of the target word in the index and trim the first one, no audio is transcribed
+int query_index(const detect_params & params) {
+    word_index index;
+    if (!index.open(params.index_file)) {
+        return 1;
+    }
+
+    // the target is found inside words and across adjacent words like in a transcript, with --max-edits every term
+    // holding an approximate occurrence of the word contributes its postings
+    fuzzy_matcher fuzzy;
+    const bool use_fuzzy = params.max_edits > 0 && fuzzy.init(params.target_word, params.max_edits);
+
+    std::vector<word_posting> hits;
+    for (const word_posting & posting : use_fuzzy ? index.lookup_fuzzy(fuzzy) : index.find(params.target_word)) {
+        const double t = posting.t * 0.01;
+        if (t >= params.t_from && (params.t_to < 0 || t < params.t_to)) {
+            hits.push_back(posting);
+        }
+    }
+
+    if (hits.empty()) {
+        fprintf(stderr, "Target word '%s' not found in %u indexed files. Not creating an output file.\n", params.target_word.c_str(), index.n_files());
+        return 0;
+    }
+
+    for (const word_posting & hit : hits) {
+        printf("%s\t%.2f\n", index.file_path(hit.file_id).c_str(), hit.t * 0.01);
+    }
+
+    fprintf(stderr, "Found target word '%s' %zu times, trimming the first occurrence.\n", params.target_word.c_str(), hits.size());
+
+    return trim_audio(index.file_path(hits[0].file_id), hits[0].t * 0.01f, params.output_file) ? 0 : 1;
+}
+
+// <audio_file> with several words: the window is transcribed once and every segment is matched against all the words
+// at once, or against each word approximately with --max-edits. Prints the first occurrence of each word, or every one
+// with --all-occurrences. No output file is created.
+int search_words(const detect_params & params) {
+    word_matcher matcher;
+    matcher.init(params.words);
+
+    // As in the single word search, a cached transcript is reused, and extended when the scan continues its coverage.
+    // Otherwise the window is transcribed on its own.
+    media_file_key file_key;
+    transcript cached;
+    transcript window;
+    transcript * record = &window;
+    bool   need_scan   = true;
+    double t_scan_from = params.t_from;
+    const bool use_transcript_cache = !params.transcript_cache_dir.empty() && media_file_key_init(params.audio_file, file_key);
+
+    if (use_transcript_cache) {
+        transcript_cache_load(params.transcript_cache_dir, file_key, transcript_config(params), cached);
+        if (cached.complete || (params.t_to >= 0 && cached.t_end >= params.t_to)) {
+            need_scan = false;
+            record    = &cached;
+            fprintf(stderr, "Answered from the transcript cache.\n");
+        } else if (cached.t_end >= params.t_from) {
+            t_scan_from = cached.t_end;
+            record      = &cached;
+        }
+    }
+
+    if (need_scan) {
+        detect_context dctx;
+        float t_found;
+        const bool ok = scan_audio(params, dctx, t_scan_from, t_found, record);
+        if (params.print_stats) {
+            detect_stats_print(dctx.stats);
+        }
+        detect_context_free(dctx);
+        if (!ok) {
+            return 1;
+        }
+        if (record == &cached) {
+            transcript_cache_save(params.transcript_cache_dir, file_key, transcript_config(params), cached);
+        }
+    }
+
+    // with --max-edits every word has its own approximate matcher
+    std::vector<fuzzy_matcher> fuzzy(params.max_edits > 0 ? params.words.size() : 0);
+    for (size_t i = 0; i < fuzzy.size(); ++i) {
+        fuzzy[i].init(params.words[i], params.max_edits);
+    }
+
+    std::vector<std::vector<double>> hits(matcher.n_words());
+    for (const transcript_segment & segment : record->segments) {
+        if (params.t_to >= 0 && segment.t_offset >= params.t_to) {
+            continue;
+        }
+        auto add_hit = [&](int i_word, size_t pos) {
+            const double t = segment.token_time(segment.token_at(pos));
+            if (t >= params.t_from && (params.t_to < 0 || t < params.t_to) && (params.all_occurrences || hits[i_word].empty())) {
+                hits[i_word].push_back(t);
+            }
+        };
+        if (fuzzy.empty()) {
+            matcher.find_all(segment.cleaned, add_hit);
+        }
+        for (size_t i = 0; i < fuzzy.size(); ++i) {
+            fuzzy[i].find_all(segment.cleaned, [&](size_t start, size_t /*end*/, int /*n_edits*/) { add_hit((int) i, start); });
+        }
+    }
+
+    size_t n_found = 0;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        for (double t : hits[i]) {
+            printf("%s\t%.3f\n", matcher.word((int) i).c_str(), t);
+        }
+        n_found += hits[i].empty() ? 0 : 1;
+    }
+
+    fprintf(stderr, "Found %zu of %zu words.\n", n_found, hits.size());
+
     return 0;
 }
+
+int main(int argc, char ** argv) {
+    whisper_log_set(whisper_log_callback, nullptr);
+    av_log_set_level(AV_LOG_ERROR);
+
+    detect_params params;
+    if (!detect_params_parse(argc, argv, params)) {
+        return 1;
+    }
+
+    if (params.mode == DETECT_MODE_BUILD_INDEX) {
+        return build_index(params);
+    }
+    if (params.mode == DETECT_MODE_QUERY) {
+        return query_index(params);
+    }
+    if (!params.words.empty()) {
+        return search_words(params);
+    }
+
+    const std::string & target_word = params.target_word;
+
+    float final_start_seconds = -1.0f;
+    bool  need_scan           = true;
+    double t_scan_from        = params.t_from;
+
+    // With --transcript-cache the stored transcript is searched first. Only audio it doesn't cover
+    // yet is transcribed, and that is appended to it when it continues the stored coverage.
+    // --forced-align transcribes nothing, so it doesn't use the cache.
+    media_file_key file_key;
+    transcript cached;
+    transcript * record = nullptr;
+    const bool use_transcript_cache = !params.transcript_cache_dir.empty() && !use_forced_align(params) &&
+        media_file_key_init(params.audio_file, file_key);
+
+    if (use_transcript_cache) {
+        transcript_cache_load(params.transcript_cache_dir, file_key, transcript_config(params), cached);
+
+        fuzzy_matcher fuzzy;
+        if (params.max_edits > 0 && fuzzy.init(target_word, params.max_edits)) {
+            final_start_seconds = (float) transcript_find_fuzzy(cached, fuzzy, params.t_from, params.t_to);
+        } else {
+            final_start_seconds = (float) transcript_find(cached, target_word, params.t_from, params.t_to);
+        }
+        if (final_start_seconds >= 0 || cached.complete || (params.t_to >= 0 && cached.t_end >= params.t_to)) {
+            need_scan = false;
+            fprintf(stderr, "Answered from the transcript cache.\n");
+        } else if (cached.t_end >= params.t_from) {
+            t_scan_from = cached.t_end;
+            record = &cached;
+        }
+    }
+
+    if (need_scan) {
+        detect_context dctx;
+        const bool ok = scan_audio(params, dctx, t_scan_from, final_start_seconds, record);
+        if (params.print_stats) {
+            detect_stats_print(dctx.stats);
+        }
+        detect_context_free(dctx);
+        if (!ok) {
+            return 1;
+        }
+        if (record) {
+            transcript_cache_save(params.transcript_cache_dir, file_key, transcript_config(params), *record);
+        }
+    }
+
+    if (final_start_seconds < 0) {
+        fprintf(stderr, "Target word '%s' not detected. Not creating an output file.\n", target_word.c_str());
+        return 0;
+    }
+
+    fprintf(stderr, "Detected target word '%s' at %.3f seconds.\n", target_word.c_str(), final_start_seconds);
+
+    return trim_audio(params.audio_file, final_start_seconds, params.output_file) ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstddef>
+
+//
+// Streaming audio utils
+//
+
+// Receives the 16 kHz mono PCM produced by read_audio_data_stream()
+struct audio_stream_sink {
+    virtual ~audio_stream_sink() {}
+
+    // Returns false if the producer should stop decoding
+    virtual bool push(const float * data, size_t n) = 0;
+
+    // Called by the producer at end of stream
+    virtual void close() = 0;
+};
+
+// Bounded single-producer / single-consumer queue of 16 kHz mono PCM samples
+//
+//   - the decoder pushes samples as soon as they are resampled and blocks while the buffer is full
+//   - the consumer pops fixed-size chunks and blocks until enough samples are available
+//   - close() is called by the producer at end of stream, cancel() by the consumer to stop decoding early
+//
+class audio_ring_buffer : public audio_stream_sink {
+public:
+    explicit audio_ring_buffer(size_t capacity) : buf(capacity) {}
+
+    // Returns false if the consumer cancelled the stream, in which case the producer should stop
+    bool push(const float * data, size_t n) override {
+        while (n > 0) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_not_full.wait(lock, [this] { return is_cancelled || count < buf.size(); });
+            if (is_cancelled) {
+                return false;
+            }
+
+            const size_t n_write = std::min(n, buf.size() - count);
+            for (size_t i = 0; i < n_write; ++i) {
+                buf[(head + count + i) % buf.size()] = data[i];
+            }
+            count += n_write;
+            data  += n_write;
+            n     -= n_write;
+
+            cv_not_empty.notify_one();
+        }
+        return true;
+    }
+
+    // Blocks until n samples are available or the stream is closed
+    // Returns the number of samples written to data, 0 at end of stream
+    size_t pop(float * data, size_t n) {
+        size_t n_read = 0;
+        while (n_read < n) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_not_empty.wait(lock, [this] { return is_closed || is_cancelled || count > 0; });
+            if (count == 0) {
+                break;
+            }
+
+            const size_t n_copy = std::min(n - n_read, count);
+            for (size_t i = 0; i < n_copy; ++i) {
+                data[n_read + i] = buf[(head + i) % buf.size()];
+            }
+            head   = (head + n_copy) % buf.size();
+            count -= n_copy;
+            n_read += n_copy;
+
+            cv_not_full.notify_one();
+        }
+        return n_read;
+    }
+
+    void close() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_closed = true;
+        cv_not_empty.notify_all();
+    }
+
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_cancelled = true;
+        cv_not_full.notify_all();
+        cv_not_empty.notify_all();
+    }
+
+private:
+    std::vector<float> buf;
+    size_t head  = 0;
+    size_t count = 0;
+
+    bool is_closed    = false;
+    bool is_cancelled = false;
+
+    std::mutex mutex;
+    std::condition_variable cv_not_full;
+    std::condition_variable cv_not_empty;
+};
+
+// Decode an audio file and push the 16 kHz mono PCM into sink as it is produced
+// Falls back to ffmpeg for formats miniaudio can't read (when built with WHISPER_FFMPEG)
+// Only the [t_from, t_to) window in seconds is decoded, t_to < 0 means until the end of the file
+// The sink is always closed on return, also on failure
+bool read_audio_data_stream(const std::string & fname, audio_stream_sink & sink, double t_from = 0.0, double t_to = -1.0);
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+// Counters of a bounded_queue, to check that producer and consumer overlap
+struct bounded_queue_stats {
+    double   push_wait_s = 0.0; // producer blocked on a full queue
+    double   pop_wait_s  = 0.0; // consumer blocked on an empty queue
+    size_t   max_depth   = 0;
+    uint64_t n_pushed    = 0;
+    uint64_t depth_sum   = 0;   // queue depth after each push, for the average
+
+    double avg_depth() const { return n_pushed > 0 ? (double) depth_sum / n_pushed : 0.0; }
+};
+
+// Bounded multi-producer / multi-consumer queue connecting two pipeline stages
+//
+//   - push() blocks while the queue is full, pop() while it is empty
+//   - close() is called by the producer at end of stream, cancel() by the consumer to stop the producer
+//
+template <typename T>
+class bounded_queue {
+public:
+    explicit bounded_queue(size_t capacity) : capacity(capacity) {}
+
+    // Returns false if the consumer cancelled the queue, in which case the producer should stop
+    bool push(T && item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!is_cancelled && items.size() >= capacity) {
+            const auto t_start = std::chrono::steady_clock::now();
+            cv_not_full.wait(lock, [this] { return is_cancelled || items.size() < capacity; });
+            stats.push_wait_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+        }
+        if (is_cancelled) {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        stats.n_pushed++;
+        stats.depth_sum += items.size();
+        stats.max_depth  = std::max(stats.max_depth, items.size());
+
+        cv_not_empty.notify_one();
+        return true;
+    }
+
+    // Blocks until an item is available, returns false at end of stream or once cancelled
+    bool pop(T & item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!is_closed && !is_cancelled && items.empty()) {
+            const auto t_start = std::chrono::steady_clock::now();
+            cv_not_empty.wait(lock, [this] { return is_closed || is_cancelled || !items.empty(); });
+            stats.pop_wait_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+        }
+        if (is_cancelled || items.empty()) {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+
+        cv_not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_closed = true;
+        cv_not_empty.notify_all();
+    }
+
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_cancelled = true;
+        items.clear();
+        cv_not_full.notify_all();
+        cv_not_empty.notify_all();
+    }
+
+    bounded_queue_stats get_stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    std::deque<T> items;
+    size_t capacity;
+
+    bool is_closed    = false;
+    bool is_cancelled = false;
+
+    bounded_queue_stats stats;
+
+    std::mutex mutex;
+    std::condition_variable cv_not_full;
+    std::condition_variable cv_not_empty;
+};
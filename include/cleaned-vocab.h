@@ -0,0 +1,55 @@
+// Cleaned text of a whisper vocabulary and matching of a cleaned word over token ids
+
+#pragma once
+
+#include "whisper.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//
+// Cleaned vocabulary
+//
+
+// Cleaned text of every token of a model, built once so that converting whisper output doesn't ask
+// whisper for the token text and clean it byte by byte for every token of every segment
+//
+// The cleaned bytes of all tokens are stored back to back in a single arena, indexed by token id
+struct cleaned_vocab {
+    std::string arena;
+    std::vector<uint32_t> offsets;    // token t is arena[offsets[t], offsets[t + 1])
+    std::vector<uint8_t>  word_start; // the token text starts with a space
+
+    bool init(struct whisper_context * ctx);
+
+    bool empty() const { return offsets.empty(); }
+    int  n_vocab() const { return offsets.empty() ? 0 : (int) offsets.size() - 1; }
+
+    const char * text(whisper_token t) const { return arena.data() + offsets[t]; }
+    uint32_t     size(whisper_token t) const { return offsets[t + 1] - offsets[t]; }
+};
+
+//
+// Token matcher
+//
+
+// Finds a cleaned word in a sequence of token ids with one table lookup per token
+//
+// The state is the length of the longest prefix of the word the cleaned text read so far ends with,
+// as in KMP. The table holds the state after every token from every state, i.e. every way the word
+// can be split over token boundaries, and whether the word ends inside the token.
+//
+struct token_matcher {
+    std::string word;
+    int n_vocab = 0;
+    std::vector<uint16_t> next; // [state * n_vocab + token], the top bit is set if the word ends inside the token
+
+    // Returns false if the word is empty or too long for a table, the caller then matches the cleaned text
+    bool init(const cleaned_vocab & vocab, const std::string & word);
+
+    bool empty() const { return next.empty(); }
+
+    // State after token, sets hit if the word ends inside it. Tokens outside the vocabulary reset the state
+    int step(int state, whisper_token token, bool & hit) const;
+};
@@ -0,0 +1,86 @@
+// Approximate search of a cleaned word in cleaned text
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Finds the occurrences of a word within max_edits insertions, deletions or substitutions
+//
+// The text is scanned with the bit-parallel algorithm of Myers in the formulation of Hyyrö: a column of
+// the edit distance matrix is held as vertical deltas in two 64-bit words, so every text character costs
+// a handful of word operations instead of a pass over the word. Words of up to 64 characters.
+//
+// A match ends at a run of consecutive positions, the best of them is reported. Its start is recovered
+// with a small dynamic program over the last max_edits + length characters.
+//
+class fuzzy_matcher {
+public:
+    // Returns false if the word is empty, longer than 64 characters or not longer than max_edits
+    bool init(const std::string & word, int max_edits);
+
+    const std::string & get_word() const { return word; }
+
+    // Call cb(start, end, n_edits) for every occurrence of the word in text[start, end)
+    template <typename F>
+    void find_all(const std::string & text, F && cb) const {
+        find_all(text.data(), text.size(), cb);
+    }
+
+    template <typename F>
+    void find_all(const char * text, size_t n_text, F && cb) const {
+        const int m = (int) word.size();
+        const uint64_t last = 1ull << (m - 1);
+
+        uint64_t pv = ~0ull;
+        uint64_t mv = 0;
+        int score = m;
+
+        // best end of the current run of matching positions
+        size_t best_end   = 0;
+        int    best_score = -1;
+
+        for (size_t i = 0; i < n_text; ++i) {
+            const uint64_t eq = peq[(unsigned char) text[i]];
+            const uint64_t xv = eq | mv;
+            const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & last) {
+                score++;
+            } else if (mh & last) {
+                score--;
+            }
+
+            // the first row of the search matrix is all zeros, a match may start anywhere
+            ph <<= 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+
+            if (score <= max_edits) {
+                if (best_score < 0 || score < best_score) {
+                    best_score = score;
+                    best_end   = i + 1;
+                }
+            } else if (best_score >= 0) {
+                cb(match_start(text, best_end), best_end, best_score);
+                best_score = -1;
+            }
+        }
+        if (best_score >= 0) {
+            cb(match_start(text, best_end), best_end, best_score);
+        }
+    }
+
+private:
+    // Start of the occurrence ending at end with the fewest edits, of those the one closest to the word's length
+    size_t match_start(const char * text, size_t end) const;
+
+    std::string word;
+    int max_edits = 0;
+    uint64_t peq[256]; // bit i is set in peq[c] if word[i] == c
+};
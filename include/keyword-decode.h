@@ -0,0 +1,76 @@
+// Decoding aids that steer whisper towards the target word
+
+#pragma once
+
+#include "whisper.h"
+
+#include <string>
+#include <vector>
+
+//
+// Keyword boost
+//
+
+// Token sequences spelling a keyword and the logit boost applied to them
+//
+// At every decoding step the first token of each spelling is boosted, and so is the next token of
+// every spelling whose beginning the decoder has just produced. This lets greedy decoding pick up
+// the keyword where it otherwise needs the wider search of beam decoding. A token shared by several
+// spellings is boosted once.
+//
+struct keyword_boost {
+    std::vector<std::vector<whisper_token>> spellings;
+    float boost = 0.0f;
+};
+
+// Tokenize the spellings of the cleaned word: lower case, capitalized and upper case, each with and
+// without a leading space. Returns false if none can be tokenized
+bool keyword_boost_init(struct whisper_context * ctx, const std::string & word, float boost, keyword_boost & kb);
+
+// whisper_logits_filter_callback, user_data is a keyword_boost
+void keyword_boost_logits_filter(
+        struct whisper_context * ctx,
+          struct whisper_state * state,
+      const whisper_token_data * tokens,
+                           int   n_tokens,
+                         float * logits,
+                          void * user_data);
+
+//
+// Keyword alignment
+//
+
+// Scores the target at a given start time of an encoded window instead of transcribing it
+//
+// The starts tried are spread over the whole window: the timestamps the decoder weighs most after the prompt
+// within a spacing of each other, where it would start a segment, and the start of every speech segment packed
+// in the window. At each, the decoder is forced through the timestamp token and the target's tokens.
+// The score of a spelling is the sum over its tokens of the target's logit minus the best logit of that step:
+// the log-probability of the target relative to what the decoder would have picked itself. 0 means
+// free decoding produces the target, every token the decoder disagrees with lowers the score.
+// The score can only go down, so a spelling isn't decoded further once it falls below the threshold.
+//
+struct keyword_align {
+    std::vector<std::vector<whisper_token>> spellings; // " word" and " Word", as whisper starts a segment
+    float threshold = -2.0f;
+};
+
+// Tokenize the spellings of the cleaned word. Returns false if none can be tokenized
+bool keyword_align_init(struct whisper_context * ctx, const std::string & word, float threshold, keyword_align & ka);
+
+// The timestamps (in 20 ms steps, up to n_ts) with the highest logit after the prompt decoded in state within
+// spacing steps on either side, best first: the logits peak at the first speech, every part of the window gets a start
+void keyword_align_candidates(struct whisper_context * ctx, struct whisper_state * state, int n_ts, int spacing, std::vector<int> & ts);
+
+// Best score of the target starting at timestamp ts (in 20 ms steps) of the window encoded in state,
+// after a prompt of n_past tokens already decoded. n_decode counts the decoder calls.
+// Below the threshold the score is that of the tokens decoded so far, an upper bound of the full score.
+// Returns -INFINITY if the decoder fails
+float keyword_align_score(
+        struct whisper_context * ctx,
+          struct whisper_state * state,
+           const keyword_align & ka,
+                           int   n_past,
+                           int   ts,
+                           int   n_threads,
+                           int & n_decode);
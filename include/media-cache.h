@@ -0,0 +1,97 @@
+// On-disk caches of per-file work, keyed by the identity of the input file
+
+#pragma once
+
+#include "audio-stream.h"
+#include "transcript.h"
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+//
+// File identity
+//
+
+// Identifies an input file across runs: path, size, mtime and a hash of its content
+// Only a few blocks of the file are hashed (head, middle, tail), so computing the key stays
+// cheap on multi-GB inputs while still catching files rewritten in place with the same mtime
+struct media_file_key {
+    std::string path; // canonical path
+    uint64_t    size          = 0;
+    int64_t     mtime_ns      = 0;
+    uint64_t    content_hash  = 0;
+};
+
+bool media_file_key_init(const std::string & fname, media_file_key & key);
+
+// Path of the cache entry for key in cache_dir, e.g. <cache_dir>/<hash>.pcm
+std::string media_cache_path(const std::string & cache_dir, const media_file_key & key, const char * ext);
+
+//
+// Decoded PCM cache
+//
+
+// A cache entry stores the 16 kHz mono float PCM of the whole file raw after a 64 byte header,
+// so it can be memory-mapped and shared through the page cache by concurrent jobs
+struct pcm_cache_mapping {
+    const float * samples   = nullptr;
+    uint64_t      n_samples = 0;
+
+    void * addr = nullptr;
+    size_t size = 0;
+};
+
+// Map the cache entry for key, returns false if there is none or it doesn't match key
+bool pcm_cache_map(const std::string & cache_dir, const media_file_key & key, pcm_cache_mapping & mapping);
+
+void pcm_cache_unmap(pcm_cache_mapping & mapping);
+
+// Push the [t_from, t_to) window of a mapped entry into sink and close it
+bool pcm_cache_stream(const pcm_cache_mapping & mapping, audio_stream_sink & sink, double t_from, double t_to);
+
+// Tees a full decode into a new cache entry while forwarding the [t_from, t_to) window to out
+// Decoding continues after out stops accepting samples, so the entry always holds the whole file
+class pcm_cache_writer : public audio_stream_sink {
+public:
+    pcm_cache_writer(audio_stream_sink & out, double t_from, double t_to);
+    ~pcm_cache_writer();
+
+    bool open(const std::string & cache_dir, const media_file_key & key);
+
+    bool push(const float * data, size_t n) override;
+    void close() override;
+
+    // Publish the entry if ok, discard it otherwise
+    bool finish(bool ok);
+
+private:
+    audio_stream_sink & out;
+    int64_t from;
+    int64_t to;
+    int64_t pos = 0;
+    bool out_open = true;
+
+    media_file_key key;
+    std::string path;
+    std::string path_tmp;
+    FILE * file = nullptr;
+};
+
+// Stream [t_from, t_to) of fname into sink like read_audio_data_stream(), going through the PCM cache
+// in cache_dir: a hit is served from the mapped entry, a miss decodes the whole file and stores it
+bool read_audio_data_cached(const std::string & fname, const std::string & cache_dir, audio_stream_sink & sink, double t_from, double t_to);
+
+//
+// Transcript cache
+//
+
+// The transcript of a file doesn't depend on the searched word, so it is stored once and later searches
+// only run the matcher over it. config identifies the decoding setup (model, beam size, ...) the
+// transcript was made with, entries for a different setup are kept apart.
+// Entries are compact binary files: per segment its offset, token ids, timestamps, probabilities and cleaned text.
+
+// Returns false if there is no entry for key and config
+bool transcript_cache_load(const std::string & cache_dir, const media_file_key & key, const std::string & config, transcript & tr);
+
+bool transcript_cache_save(const std::string & cache_dir, const media_file_key & key, const std::string & config, const transcript & tr);
@@ -0,0 +1,216 @@
+// Parallel transcription of speech segments on whisper states sharing one model
+
+#pragma once
+
+#include "whisper.h"
+#include "transcript.h"
+#include "vad-stream.h"
+#include "keyword-decode.h"
+#include "fuzzy-match.h"
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Samples [packed, packed + length) of a packed job come from [start, start + length) of the file
+struct transcribe_piece {
+    int64_t packed;
+    int64_t start;
+    int64_t length;
+};
+
+// Speech to transcribe and, once handed back by the pool, its transcript
+struct transcribe_job {
+    int64_t seq      = 0;   // assigned by transcribe_pool::submit()
+    double  t_offset = 0.0; // absolute start in seconds of samples
+    std::vector<float> samples;
+
+    // A packed job concatenates several speech segments, its pieces map whisper's timestamps back to the file
+    // Empty for a single contiguous segment starting at t_offset
+    std::vector<transcribe_piece> pieces;
+
+    // absolute time in seconds of t seconds into samples, times in the silence between pieces snap to the nearer piece
+    double source_time(double t) const;
+
+    // index of the piece t seconds into samples belongs to, snapped like source_time(). Needs pieces
+    int piece_at(double t) const;
+
+    bool ok = false;
+    std::vector<transcript_segment> segments;
+    double t_found = -1.0; // absolute start time of the first occurrence of the target, -1 if none
+    double t_end   = 0.0;  // absolute end of the transcribed audio, before the end of samples on an early exit
+};
+
+// Concatenates consecutive speech segments into jobs of up to max_samples, separated by a short silence
+// whisper pads every call to a 30 s window, so a packed job costs one encoder pass instead of one per segment
+// A job spans at most 2 * max_samples of the file, so sparse speech isn't held back until the end of the stream
+class transcribe_packer {
+public:
+    explicit transcribe_packer(int64_t max_samples) : max_samples(max_samples) {}
+
+    // Add segment to the pending job. If it doesn't fit, the pending job is first moved into full and true is returned
+    bool add(speech_segment && segment, transcribe_job & full);
+
+    // Move the pending job into job, returns false if there is none
+    bool flush(transcribe_job & job);
+
+    // Move the pending job into job if position is more than 2 * max_samples past its start, so that the
+    // speech before a long stretch without any isn't held back until the next segment. Returns false otherwise
+    bool flush_stale(int64_t position, transcribe_job & job);
+
+    // Absolute position in samples of the first sample of the pending job, INT64_MAX if there is none
+    int64_t pending_start() const;
+
+private:
+    int64_t max_samples;
+    transcribe_job pending;
+};
+
+struct transcribe_pool_params {
+    whisper_full_params wparams;
+    std::string target;    // an empty target only transcribes
+    const cleaned_vocab * vocab = nullptr; // of ctx, to convert whisper output without cleaning token text
+    const token_matcher * matcher = nullptr; // of the target over the vocabulary of ctx, finds it by token id
+    const fuzzy_matcher * fuzzy = nullptr; // match the target within a few edits instead of exactly
+    int  n_threads = 1;    // split between the states
+
+    // Size audio_ctx to each job instead of always encoding a 30 s window. A job that yields no tokens
+    // with the reduced context is run again at full context.
+    bool adaptive_audio_ctx = false;
+
+    // Adaptive beam: with wparams set to beam search, every job is first decoded greedily. It is decoded
+    // again with beam search if a segment's average token probability is below escalate_p, or if a word
+    // comes close to the target without matching it (similarity() of at least escalate_similarity)
+    float escalate_p          = 0.0f; // 0 disables
+    float escalate_similarity = 0.75f;
+
+    // With wparams.language "auto" whisper detects the language on every job. Instead detect it on
+    // the jobs themselves until one is confident, then pin it for every later job. Meant for
+    // monolingual audio: a pool serves a single file. Ignored for a model that isn't multilingual,
+    // after a few unconfident jobs the most likely language is pinned.
+    bool pin_language = false;
+
+    // Score every job for the target by forced alignment instead of transcribing it. Jobs have no
+    // segments then, a hit only sets t_found.
+    const keyword_align * align = nullptr;
+
+    // Cascade: every job is first transcribed by the screening model with screen_wparams, only jobs
+    // with a word whose similarity() to the target reaches screen_threshold are transcribed by ctx.
+    // The screening transcript stands for the other jobs. Requires a target.
+    struct whisper_context * screen_ctx = nullptr;
+    const cleaned_vocab * screen_vocab = nullptr;
+    whisper_full_params screen_wparams;
+    float screen_threshold = 0.75f;
+};
+
+struct transcribe_pool_stats {
+    uint64_t n_jobs        = 0;
+    uint64_t n_reruns      = 0; // adaptive audio_ctx jobs rerun at full context
+    uint64_t n_frames      = 0; // encoder frames computed
+    uint64_t n_frames_full = 0; // encoder frames the same jobs cost at full context
+    double   t_whisper_s   = 0.0;
+
+    uint64_t n_align_decode = 0; // decoder calls of forced alignment
+
+    uint64_t n_greedy      = 0; // adaptive beam jobs decoded greedily first
+    uint64_t n_escalated   = 0; // of those, decoded again with beam search
+
+    uint64_t n_lang_detect   = 0; // jobs the language was detected on
+    uint64_t n_lang_pinned   = 0; // jobs run with the pinned language
+    double   t_lang_detect_s = 0.0;
+
+    uint64_t n_screened    = 0; // jobs transcribed by the screening model
+    uint64_t n_confirmed   = 0; // screened jobs close enough to the target to go through the main model
+    double   t_screen_s    = 0.0;
+};
+
+// Transcribes jobs on several whisper_states of one whisper_context
+//
+//   - the model weights are loaded once, a state only holds its own KV cache and compute buffers
+//   - every state runs on its own worker thread with an equal share of the thread budget,
+//     which scales better than giving all threads to a single whisper_full() on short segments
+//   - finished jobs are handed back strictly in submission order, so the first hit returned
+//     is also the first occurrence in time
+//   - a job stops decoding as soon as a segment with the target is emitted
+//   - jobs may finish out of order: once a job has a hit, every later job is dropped from the queue and
+//     in-flight ones are aborted through abort_callback, since they can't hold the first occurrence anymore
+//
+class transcribe_pool {
+public:
+    ~transcribe_pool();
+
+    // Start one worker per state, screen_states holds a state of params.screen_ctx for each of them
+    void start(struct whisper_context * ctx, const std::vector<struct whisper_state *> & states, const transcribe_pool_params & params,
+               const std::vector<struct whisper_state *> & screen_states = std::vector<struct whisper_state *>());
+
+    // Queue a job, returns its sequence number
+    int64_t submit(transcribe_job && job);
+
+    // Blocks until the oldest job not handed back yet is done and moves it into job
+    // Returns false if there are no jobs left or the pool was cancelled
+    bool next(transcribe_job & job);
+
+    // True if next() wouldn't block
+    bool ready();
+
+    // Drop all jobs not handed back yet
+    void cancel();
+
+    // Cancel and join the workers
+    void stop();
+
+    transcribe_pool_stats get_stats();
+
+    // Language pinned with pin_language, -1 if none yet
+    int pinned_language() const { return pinned_lang; }
+
+private:
+    struct worker_context {
+        transcribe_pool * pool = nullptr;
+        transcribe_job  * job  = nullptr; // being transcribed
+        std::atomic<bool> found{false};   // job hit the target, the rest of its decode is skipped
+    };
+
+    void worker(struct whisper_state * state, struct whisper_state * screen_state, whisper_full_params wparams);
+    void detect_language(struct whisper_context * lang_ctx, struct whisper_state * lang_state, int n_threads, const transcribe_job & job, transcribe_pool_stats & job_stats);
+    void align(struct whisper_state * state, const whisper_full_params & wparams, transcribe_job & job, transcribe_pool_stats & job_stats);
+    bool is_confident(const transcribe_job & job) const;
+    bool screen(struct whisper_state * screen_state, const whisper_full_params & wparams, transcribe_job & job, transcribe_pool_stats & job_stats);
+    void run(struct whisper_state * state, const whisper_full_params & wparams, transcribe_job & job, transcribe_pool_stats & job_stats);
+
+    // whisper_full() callbacks of the workers, user_data is their worker_context
+    static bool abort_job(void * user_data);
+    static void on_new_segment(struct whisper_context * ctx, struct whisper_state * state, int n_new, void * user_data);
+
+    struct whisper_context * ctx = nullptr;
+    transcribe_pool_params params;
+    transcribe_pool_stats stats;
+
+    std::vector<std::thread> workers;
+
+    std::deque<transcribe_job> queue;
+    std::map<int64_t, transcribe_job> done;
+    int64_t n_submitted = 0;
+    int64_t next_seq    = 0;
+    bool is_stopping    = false;
+
+    // read by abort_job() without the lock
+    std::atomic<bool>    is_cancelled{false};
+    std::atomic<int64_t> hit_seq{INT64_MAX}; // earliest job with a hit so far
+    std::atomic<int>     pinned_lang{-1};
+    std::atomic<bool>    lang_given_up{false}; // language detection failed on every try, run with "auto"
+
+    // language probabilities summed over the jobs detected without a confident language
+    std::vector<float> lang_p_sum;
+    int n_lang_unsure = 0;
+
+    std::mutex mutex;
+    std::condition_variable cv_queue;
+    std::condition_variable cv_done;
+};
@@ -0,0 +1,104 @@
+// Word-level view of whisper output, shared by the live search and the caches
+
+#pragma once
+
+#include "whisper.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct cleaned_vocab;
+struct token_matcher;
+class fuzzy_matcher;
+
+// lowercase the alphanumeric characters of word and drop everything else
+std::string clean_word(const std::string & word);
+
+// append the cleaned characters of token_text to accumulated
+void append_cleaned_word(const char * token_text, std::string & accumulated);
+
+enum transcript_token_flags {
+    TRANSCRIPT_TOKEN_WORD_START = 1, // the token text starts with a space, i.e. it begins a new word
+};
+
+struct transcript_token {
+    whisper_token id;
+    int32_t  t0;       // token timestamps in centiseconds, relative to the segment offset
+    int32_t  t1;
+    float    p;
+    uint32_t text_end; // end of the token's cleaned text in transcript_segment::cleaned
+    uint32_t flags;
+};
+
+// One whisper text segment, timestamp tokens excluded
+struct transcript_segment {
+    double t_offset = 0.0; // absolute start in seconds of the audio whisper transcribed
+    std::string cleaned;   // cleaned text of all tokens, concatenated
+    std::vector<transcript_token> tokens;
+
+    // index of the token the cleaned character at pos belongs to
+    int token_at(size_t pos) const;
+
+    // absolute start time in seconds of token i
+    double token_time(int i) const { return t_offset + tokens[i].t0 * 0.01; }
+
+    // start of the cleaned text of token i
+    uint32_t text_begin(int i) const { return i > 0 ? tokens[i - 1].text_end : 0; }
+};
+
+// All segments transcribed so far for a file, in time order
+struct transcript {
+    std::vector<transcript_segment> segments;
+    double t_end    = 0.0;   // speech in [0, t_end) has been transcribed
+    bool   complete = false; // the whole file has been transcribed
+
+    // Segments transcribed after a job whisper failed on are kept for searching, but only the ones before
+    // the gap are cached: t_end stops at its start, so a later run transcribes the rest again
+    size_t n_before_gap = SIZE_MAX;
+};
+
+// Convert whisper segment i_segment of the last whisper_full() call on state
+// With vocab the cleaned token text is looked up instead of asked from whisper and cleaned
+void transcript_segment_from_whisper(
+        struct whisper_context * ctx,
+          struct whisper_state * state,
+                           int   i_segment,
+                        double   t_offset,
+            transcript_segment & segment,
+           const cleaned_vocab * vocab = nullptr);
+
+// Find the first occurrence of the cleaned target in segment, returns its absolute start time or -1
+double transcript_segment_find(const transcript_segment & segment, const std::string & target);
+
+// Same with the matcher's table over the token ids, the cleaned text is only searched around the token
+// the target ends in. The matcher must be built from the vocabulary of the model that produced segment
+double transcript_segment_find(const transcript_segment & segment, const token_matcher & matcher);
+
+// Split the segment into cleaned words, calling cb(word, t_word) with the absolute start time of each
+template <typename F>
+void transcript_segment_for_each_word(const transcript_segment & segment, F && cb) {
+    int i_begin = -1;
+    for (int i = 0; i <= (int) segment.tokens.size(); ++i) {
+        const bool word_end = i == (int) segment.tokens.size() || (segment.tokens[i].flags & TRANSCRIPT_TOKEN_WORD_START);
+        if (word_end && i_begin >= 0) {
+            const uint32_t begin = segment.text_begin(i_begin);
+            const uint32_t end   = segment.text_begin(i);
+            if (end > begin) {
+                cb(segment.cleaned.substr(begin, end - begin), segment.token_time(i_begin));
+            }
+            i_begin = -1;
+        }
+        if (i < (int) segment.tokens.size() && i_begin < 0) {
+            i_begin = i;
+        }
+    }
+}
+
+// Find the first occurrence of the cleaned target starting in [t_from, t_to), t_to < 0 means no end
+// Returns its absolute start time or -1
+double transcript_find(const transcript & tr, const std::string & target, double t_from, double t_to);
+
+// Same as transcript_segment_find() and transcript_find() for approximate occurrences of the matcher's word
+double transcript_segment_find_fuzzy(const transcript_segment & segment, const fuzzy_matcher & matcher);
+double transcript_find_fuzzy(const transcript & tr, const fuzzy_matcher & matcher, double t_from, double t_to);
@@ -0,0 +1,47 @@
+// Incremental voice activity detection over a stream of 16 kHz mono PCM
+
+#pragma once
+
+#include "whisper.h"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// A stretch of speech and its position in the file
+struct speech_segment {
+    int64_t start = 0; // absolute position of samples[0] in the file, in samples
+    std::vector<float> samples;
+
+    int64_t end() const { return start + (int64_t) samples.size(); }
+};
+
+// Splits a stream into speech segments without seams at block boundaries
+//
+// Every pushed block is run through the VAD together with the audio held back from the previous one.
+// Speech that reaches the end of the block may continue in the next one, so it is held back instead of
+// being emitted: a word straddling a block boundary ends up in a single segment.
+// The VAD only sees the held back audio twice, so the cost stays linear in the length of the stream.
+//
+class vad_stream {
+public:
+    vad_stream(struct whisper_vad_context * vctx, const whisper_vad_params & params, int64_t start);
+
+    // Append the speech segments that are complete after the next block of audio to out
+    void push(const float * data, size_t n, std::vector<speech_segment> & out);
+
+    // End of stream: append the held back speech to out
+    void flush(std::vector<speech_segment> & out);
+
+    // Absolute position in samples up to which all speech has been emitted
+    int64_t position() const { return window_start; }
+
+private:
+    void process(bool final, std::vector<speech_segment> & out);
+
+    struct whisper_vad_context * vctx;
+    whisper_vad_params params;
+
+    std::vector<float> window; // held back audio followed by the new block
+    int64_t window_start;      // absolute position of window[0]
+};
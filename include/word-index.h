@@ -0,0 +1,67 @@
+// Corpus-wide inverted index: cleaned word -> (file, timestamp) postings
+
+#pragma once
+
+#include "transcript.h"
+#include "fuzzy-match.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct word_posting {
+    uint32_t file_id;
+    uint32_t t;   // absolute start time of the word in centiseconds
+    uint32_t pos; // ordinal of the word in the file, the words of different segments are never adjacent
+};
+
+// Collects the words of transcribed files and writes the index
+//
+// The index file is designed to be memory-mapped:
+//   - a header, the file table and the term table sorted by term for binary search
+//   - per term its postings sorted by (file, position), delta and varint encoded
+//   - a string pool with the file paths and terms
+//
+class word_index_builder {
+public:
+    // Returns the id of the new file
+    uint32_t add_file(const std::string & path);
+
+    // Add every word of tr for file_id, words are cleaned the same way as the target word
+    void add_transcript(uint32_t file_id, const transcript & tr);
+
+    bool write(const std::string & path) const;
+
+private:
+    std::vector<std::string> files;
+    std::vector<uint32_t> n_words; // next word ordinal per file
+    std::map<std::string, std::vector<word_posting>> postings;
+};
+
+class word_index {
+public:
+    ~word_index();
+
+    bool open(const std::string & path);
+    void close();
+
+    uint32_t n_files() const;
+    std::string file_path(uint32_t file_id) const;
+
+    // Postings of the cleaned word in (file, time) order, empty if it doesn't occur in the corpus
+    std::vector<word_posting> lookup(const std::string & word) const;
+
+    // Every occurrence of the cleaned target in the cleaned text of a segment, like the search of a transcript:
+    // inside a word or running across adjacent words ("york", "newyork"), in (file, time) order
+    // The posting of a hit is the one of the word it starts in
+    std::vector<word_posting> find(const std::string & target) const;
+
+    // Postings of every term holding an occurrence of the matcher's word, in (file, time) order
+    // The term table is scanned, which stays fast since a corpus has far fewer terms than postings
+    std::vector<word_posting> lookup_fuzzy(const fuzzy_matcher & matcher) const;
+
+private:
+    const uint8_t * data = nullptr;
+    size_t size = 0;
+};
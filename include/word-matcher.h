@@ -0,0 +1,47 @@
+// Search of many cleaned words in a single pass over cleaned text
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Aho–Corasick automaton over a set of cleaned words
+//
+// The failure links are folded into the transitions, so reading a character is a single table lookup
+// whatever the number of words. Every state also links to the longest word ending there and to the
+// next state on its failure chain that ends a word, so all words ending at a position are reported.
+//
+class word_matcher {
+public:
+    // Build the automaton, words must be cleaned, non-empty and distinct
+    void init(const std::vector<std::string> & words);
+
+    size_t n_words() const { return words.size(); }
+    const std::string & word(int i) const { return words[i]; }
+
+    // Call cb(i_word, pos) for every occurrence of a word in the cleaned text, pos is its start
+    template <typename F>
+    void find_all(const std::string & text, F && cb) const {
+        int state = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            const int c = char_index(text[i]);
+            state = c < 0 ? 0 : next[state * k_n_chars + c];
+            for (int s = out[state] >= 0 ? state : out_link[state]; s > 0; s = out_link[s]) {
+                cb(out[s], i + 1 - words[out[s]].size());
+            }
+        }
+    }
+
+private:
+    static const int k_n_chars = 36; // cleaned text is [0-9a-z]
+
+    static int char_index(char c) {
+        return c >= '0' && c <= '9' ? c - '0' : (c >= 'a' && c <= 'z' ? c - 'a' + 10 : -1);
+    }
+
+    std::vector<std::string> words;
+
+    std::vector<int> next;     // [state * k_n_chars + c]
+    std::vector<int> out;      // word ending at the state, -1 if none
+    std::vector<int> out_link; // nearest state on the failure chain ending a word, 0 if none
+};
@@ -0,0 +1,105 @@
+#include "cleaned-vocab.h"
+#include "transcript.h"
+
+#include <cstdio>
+
+// Longest word with a transition table, a table takes 2 * (length + 1) bytes per token
+static const size_t k_token_matcher_max_word = 64;
+
+static const uint16_t k_token_matcher_hit = 0x8000;
+
+//
+// Cleaned vocabulary
+//
+
+bool cleaned_vocab::init(struct whisper_context * ctx) {
+    const int n = whisper_n_vocab(ctx);
+
+    arena.clear();
+    offsets.assign(1, 0);
+    word_start.assign(n, 0);
+    offsets.reserve(n + 1);
+
+    for (whisper_token t = 0; t < n; ++t) {
+        const char * token_text = whisper_token_to_str(ctx, t);
+        append_cleaned_word(token_text, arena);
+        offsets.push_back((uint32_t) arena.size());
+        word_start[t] = token_text && token_text[0] == ' ';
+    }
+
+    if (n <= 0) {
+        fprintf(stderr, "%s: empty vocabulary\n", __func__);
+        offsets.clear();
+        return false;
+    }
+
+    return true;
+}
+
+//
+// Token matcher
+//
+
+bool token_matcher::init(const cleaned_vocab & vocab, const std::string & word) {
+    this->word = word;
+    n_vocab    = vocab.n_vocab();
+    next.clear();
+
+    const int m = (int) word.size();
+    if (m == 0 || word.size() > k_token_matcher_max_word || n_vocab == 0) {
+        return false;
+    }
+
+    // KMP automaton over bytes: delta[s][c] is the state after byte c in state s < m
+    std::vector<int> fail(m + 1, 0);
+    for (int i = 1, k = 0; i < m; ++i) {
+        while (k > 0 && word[i] != word[k]) {
+            k = fail[k];
+        }
+        if (word[i] == word[k]) {
+            ++k;
+        }
+        fail[i + 1] = k;
+    }
+    std::vector<uint8_t> delta(m * 256);
+    for (int s = 0; s < m; ++s) {
+        for (int c = 0; c < 256; ++c) {
+            int k = s;
+            while (k > 0 && word[k] != (char) c) {
+                k = fail[k];
+            }
+            delta[s * 256 + c] = (uint8_t) (word[k] == (char) c ? k + 1 : 0);
+        }
+    }
+
+    // run the cleaned text of every token from every state, a full match continues from its longest border
+    next.resize((size_t) m * n_vocab);
+    for (int s = 0; s < m; ++s) {
+        for (whisper_token t = 0; t < n_vocab; ++t) {
+            const char * text = vocab.text(t);
+            const uint32_t n  = vocab.size(t);
+
+            uint16_t hit = 0;
+            int state = s;
+            for (uint32_t i = 0; i < n; ++i) {
+                state = delta[state * 256 + (unsigned char) text[i]];
+                if (state == m) {
+                    hit   = k_token_matcher_hit;
+                    state = fail[m];
+                }
+            }
+            next[(size_t) s * n_vocab + t] = (uint16_t) state | hit;
+        }
+    }
+
+    return true;
+}
+
+int token_matcher::step(int state, whisper_token token, bool & hit) const {
+    if (token < 0 || token >= n_vocab) {
+        return 0;
+    }
+    const uint16_t e = next[(size_t) state * n_vocab + token];
+    hit = hit || (e & k_token_matcher_hit);
+    return e & ~k_token_matcher_hit;
+}
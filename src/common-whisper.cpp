@@ -1,6 +1,7 @@
 #define _USE_MATH_DEFINES // for M_PI
 
 #include "common-whisper.h"
+#include "audio-stream.h"
 
 #include "common.h"
 
@@ -37,6 +38,8 @@
 #ifdef WHISPER_FFMPEG
 // as implemented in ffmpeg_trancode.cpp only embedded in common lib if whisper built with ffmpeg support
 extern int ffmpeg_decode_audio(const std::string & ifname, std::vector<uint8_t> & wav_data);
+extern int ffmpeg_decode_audio_f32(const std::string & ifname, std::vector<float> & pcmf32);
+extern int ffmpeg_decode_audio_stream(const std::string & ifname, audio_stream_sink & sink, double t_from, double t_to);
 #endif
 
 bool read_audio_data(const std::string & fname, std::vector<float>& pcmf32, std::vector<std::vector<float>>& pcmf32s, bool stereo) {
@@ -74,6 +77,17 @@ bool read_audio_data(const std::string & fname, std::vector<float>& pcmf32, std:
     }
     else if (((result = ma_decoder_init_file(fname.c_str(), &decoder_config, &decoder)) != MA_SUCCESS)) {
 #if defined(WHISPER_FFMPEG)
+		if (!stereo) {
+			// mono output: let swresample write f32 samples straight into pcmf32
+			if (ffmpeg_decode_audio_f32(fname, pcmf32) != 0) {
+				fprintf(stderr, "error: failed to ffmpeg decode '%s'\n", fname.c_str());
+
+				return false;
+			}
+
+			return true;
+		}
+
 		if (ffmpeg_decode_audio(fname, audio_data) != 0) {
 			fprintf(stderr, "error: failed to ffmpeg decode '%s'\n", fname.c_str());
 
@@ -133,6 +147,92 @@ bool read_audio_data(const std::string & fname, std::vector<float>& pcmf32, std:
     return true;
 }
 
+bool read_audio_data_stream(const std::string & fname, audio_stream_sink & sink, double t_from, double t_to) {
+    std::vector<uint8_t> audio_data; // used for pipe input from stdin
+
+    ma_result result;
+    ma_decoder_config decoder_config;
+    ma_decoder decoder;
+
+    decoder_config = ma_decoder_config_init(ma_format_f32, 1, WHISPER_SAMPLE_RATE);
+
+    if (fname == "-") {
+		#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+		#endif
+
+		uint8_t buf[1024];
+		while (true)
+		{
+			const size_t n = fread(buf, 1, sizeof(buf), stdin);
+			if (n == 0) {
+				break;
+			}
+			audio_data.insert(audio_data.end(), buf, buf + n);
+		}
+
+		if ((result = ma_decoder_init_memory(audio_data.data(), audio_data.size(), &decoder_config, &decoder)) != MA_SUCCESS) {
+			fprintf(stderr, "Error: failed to open audio data from stdin (%s)\n", ma_result_description(result));
+			sink.close();
+
+			return false;
+		}
+    }
+    else if (((result = ma_decoder_init_file(fname.c_str(), &decoder_config, &decoder)) != MA_SUCCESS)) {
+#if defined(WHISPER_FFMPEG)
+		const bool ok = ffmpeg_decode_audio_stream(fname, sink, t_from, t_to) == 0;
+		if (!ok) {
+			fprintf(stderr, "error: failed to ffmpeg decode '%s'\n", fname.c_str());
+		}
+		sink.close();
+
+		return ok;
+#else
+		fprintf(stderr, "error: failed to read audio data from '%s' (%s)\n", fname.c_str(), ma_result_description(result));
+		sink.close();
+
+		return false;
+#endif
+    }
+
+    if (t_from > 0) {
+        if ((result = ma_decoder_seek_to_pcm_frame(&decoder, (ma_uint64)(t_from * WHISPER_SAMPLE_RATE))) != MA_SUCCESS) {
+            fprintf(stderr, "error: failed to seek to %.3f s (%s)\n", t_from, ma_result_description(result));
+            ma_decoder_uninit(&decoder);
+            sink.close();
+
+            return false;
+        }
+    }
+
+    // push the decoded audio in blocks of one second so the consumer can start right away
+    std::vector<float> block(WHISPER_SAMPLE_RATE);
+    ma_uint64 frames_left = t_to >= 0 ? (ma_uint64)(std::max(0.0, t_to - t_from) * WHISPER_SAMPLE_RATE) : ~(ma_uint64)0;
+    bool ok = true;
+
+    while (frames_left > 0) {
+        ma_uint64 frames_read = 0;
+        result = ma_decoder_read_pcm_frames(&decoder, block.data(), std::min<ma_uint64>(block.size(), frames_left), &frames_read);
+        if (frames_read > 0 && !sink.push(block.data(), frames_read)) {
+            break;
+        }
+        frames_left -= frames_read;
+        if (result == MA_AT_END || frames_read == 0) {
+            break;
+        }
+        if (result != MA_SUCCESS) {
+            fprintf(stderr, "error: failed to read the frames of the audio data (%s)\n", ma_result_description(result));
+            ok = false;
+            break;
+        }
+    }
+
+    ma_decoder_uninit(&decoder);
+    sink.close();
+
+    return ok;
+}
+
 //  500 -> 00:05.000
 // 6000 -> 01:00.000
 std::string to_timestamp(int64_t t, bool comma) {
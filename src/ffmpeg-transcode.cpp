@@ -10,6 +10,7 @@
 // Just for conveninent C++ API
 #include <vector>
 #include <string>
+#include <chrono>
 
 // C
 #include <stdio.h>
@@ -21,7 +22,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/mman.h>
+#include <errno.h>
+
+#include "audio-stream.h"
 
 extern "C" {
 #include <libavutil/opt.h>
@@ -40,9 +43,13 @@ typedef uint8_t   u8;
 typedef int8_t    s8;
 
 #define WAVE_SAMPLE_RATE	16000
-#define AVIO_CTX_BUF_SZ		 4096
+#define AVIO_CTX_BUF_SZ		65536
 
 static const char* ffmpegLog = getenv("FFMPEG_LOG");
+// size of the avio read buffer in bytes, overrides AVIO_CTX_BUF_SZ
+static const char* ffmpegAvioBufSz = getenv("FFMPEG_AVIO_BUF_SZ");
+// number of decoder threads, 0 (default) lets libavcodec pick one per core
+static const char* ffmpegThreads = getenv("FFMPEG_THREADS");
 // Todo: add __FILE__ __LINE__
 #define LOG(...) \
   do { if (ffmpegLog) fprintf(stderr, __VA_ARGS__); } while(0) // C99
@@ -91,9 +98,10 @@ struct wave_hdr {
 	int data_bytes;
 } __attribute__((__packed__));
 
-struct audio_buffer {
-	u8 *ptr;
-	int size; /* size left in the buffer */
+struct audio_input {
+	int fd;
+	s64 pos;  /* current read offset */
+	s64 size; /* size of the file */
 };
 
 static void set_wave_hdr(wave_hdr& wh, size_t size) {
@@ -118,38 +126,233 @@ static void write_wave_hdr(int fd, size_t size) {
 	write(fd, &wh, sizeof(struct wave_hdr));
 }
 
-static int map_file(int fd, u8 **ptr, size_t *size)
+static int open_input(const std::string &ifname, struct audio_input *in)
 {
 	struct stat sb;
 
-	fstat(fd, &sb);
-	*size = sb.st_size;
-
-    *ptr = (u8*)mmap(NULL, *size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
-	if (*ptr == MAP_FAILED) {
-		perror("mmap");
+	in->fd = open(ifname.c_str(), O_RDONLY);
+	if (in->fd == -1) {
+		fprintf(stderr, "Couldn't open input file %s\n", ifname.c_str());
+		return -1;
+	}
+	if (fstat(in->fd, &sb) == -1) {
+		perror("fstat");
+		close(in->fd);
 		return -1;
 	}
+	in->pos = 0;
+	in->size = sb.st_size;
 
 	return 0;
 }
 
+/*
+ * Only the pages libavformat actually asks for are read, so containers
+ * with the index at the end (moov last) can be seeked instead of scanned.
+ * The streams other than the decoded one are discarded, so demuxers that
+ * locate packets through an index (e.g. mp4) skip over their data instead
+ * of reading it; other demuxers still read past it.
+ */
 static int read_packet(void *opaque, u8 *buf, int buf_size)
 {
-    struct audio_buffer *audio_buf = (audio_buffer*)opaque;
+	struct audio_input *in = (audio_input*)opaque;
+	ssize_t n;
+
+	n = pread(in->fd, buf, buf_size, in->pos);
+	if (n < 0)
+		return AVERROR(errno);
+	if (n == 0)
+		return AVERROR_EOF;
+
+	in->pos += n;
+
+	return (int)n;
+}
+
+static s64 seek_packet(void *opaque, s64 offset, int whence)
+{
+	struct audio_input *in = (audio_input*)opaque;
+	s64 pos;
+
+	switch (whence & ~AVSEEK_FORCE) {
+	case AVSEEK_SIZE:
+		return in->size;
+	case SEEK_SET:
+		pos = offset;
+		break;
+	case SEEK_CUR:
+		pos = in->pos + offset;
+		break;
+	case SEEK_END:
+		pos = in->size + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
 
-	buf_size = FFMIN(buf_size, audio_buf->size);
+	if (pos < 0)
+		return AVERROR(EINVAL);
 
-	/* copy internal buffer data to buf */
-	memcpy(buf, audio_buf->ptr, buf_size);
-	audio_buf->ptr += buf_size;
-	audio_buf->size -= buf_size;
+	in->pos = pos;
 
-	return buf_size;
+	return pos;
 }
 
-static void convert_frame(struct SwrContext *swr, AVCodecContext *codec,
-			  AVFrame *frame, std::vector<s16> & data, bool flush)
+/*
+ * Receives the resampled 16khz mono samples as they are produced.
+ * swr_convert() writes straight into the memory returned by reserve(),
+ * commit() then publishes the samples actually converted and returns
+ * false to stop decoding early.
+ * The storage is persistent across frames, nr_allocs counts how many
+ * times it had to grow.
+ */
+struct sample_sink {
+	enum AVSampleFormat fmt;
+	s64 nr_allocs = 0;
+
+	explicit sample_sink(enum AVSampleFormat fmt) : fmt(fmt) {}
+	virtual ~sample_sink() {}
+	/* called once before decoding with the expected number of samples */
+	virtual void prepare(s64 nr_samples) { (void)nr_samples; }
+	virtual u8 *reserve(int nr_samples) = 0;
+	virtual bool commit(int nr_samples) = 0;
+};
+
+template <typename T>
+struct vector_sink : sample_sink {
+	std::vector<T> & data;
+	size_t old_size = 0;
+
+	vector_sink(std::vector<T> & data, enum AVSampleFormat fmt) : sample_sink(fmt), data(data) {}
+
+	void prepare(s64 nr_samples) override {
+		if (nr_samples <= 0)
+			return;
+
+		data.reserve(data.size() + (size_t)nr_samples);
+		nr_allocs++;
+	}
+
+	u8 *reserve(int nr_samples) override {
+		old_size = data.size();
+		if (old_size + nr_samples > data.capacity())
+			nr_allocs++;
+		data.resize(old_size + nr_samples);
+		return (u8 *)(data.data() + old_size);
+	}
+
+	bool commit(int nr_samples) override {
+		data.resize(old_size + FFMAX(nr_samples, 0));
+		return true;
+	}
+};
+
+struct stream_sink : sample_sink {
+	audio_stream_sink & out;
+	std::vector<float> scratch;
+
+	explicit stream_sink(audio_stream_sink & out) : sample_sink(AV_SAMPLE_FMT_FLT), out(out) {}
+
+	u8 *reserve(int nr_samples) override {
+		if ((size_t)nr_samples > scratch.size()) {
+			scratch.resize(nr_samples);
+			nr_allocs++;
+		}
+		return (u8 *)scratch.data();
+	}
+
+	bool commit(int nr_samples) override {
+		if (nr_samples <= 0)
+			return true;
+
+		return out.push(scratch.data(), nr_samples);
+	}
+};
+
+/*
+ * Restricts the output to the samples in [from, to), positions are in
+ * 16khz samples from the start of the stream. Decoding after a seek starts
+ * at the keyframe before the window, so the position of the first frame is
+ * set from its timestamp and everything before the window is dropped.
+ * Seeking is not exact for every format (e.g. VBR mp3 without an index):
+ * if the first frame starts after the window, the gap is filled with
+ * silence so that the first sample written is still the one at from.
+ * A first frame without a timestamp is taken to start at from.
+ */
+struct window_sink : sample_sink {
+	sample_sink & inner;
+	s64 from;
+	s64 to;
+	s64 pos = 0;
+	s64 nr_written = 0;
+	bool positioned = false;
+	u8 *buffer = NULL;
+
+	window_sink(sample_sink & inner, s64 from, s64 to) : sample_sink(inner.fmt), inner(inner), from(from), to(to) {}
+
+	// Return false if the sink asked to stop decoding while padding
+	bool set_position(const AVFrame *frame, const AVStream *stream, s64 start_time) {
+		const AVRational out_time_base = { 1, WAVE_SAMPLE_RATE };
+
+		pos = from;
+		if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+			pos = av_rescale_q(frame->best_effort_timestamp - start_time,
+					   stream->time_base, out_time_base);
+		}
+		positioned = true;
+
+		const s64 nr_pad = FFMIN(pos, to) - from;
+		if (nr_pad > 0)
+			LOG("decode_audio: first frame %lld samples after the window, padding with silence\n", (long long)nr_pad);
+
+		const int bps = av_get_bytes_per_sample(fmt);
+		for (s64 nr_left = nr_pad; nr_left > 0; ) {
+			const int n = (int)FFMIN(nr_left, (s64)WAVE_SAMPLE_RATE);
+			memset(inner.reserve(n), 0, (size_t)n * bps);
+			nr_left -= n;
+			nr_written += n;
+			if (!inner.commit(n))
+				return false;
+		}
+
+		return pos < to;
+	}
+
+	void prepare(s64 nr_samples) override {
+		inner.prepare(nr_samples);
+	}
+
+	u8 *reserve(int nr_samples) override {
+		buffer = inner.reserve(nr_samples);
+		return buffer;
+	}
+
+	bool commit(int nr_samples) override {
+		if (nr_samples <= 0)
+			return inner.commit(0);
+
+		const s64 begin = FFMAX(pos, from);
+		const s64 end = FFMIN(pos + nr_samples, to);
+		const int skip = (int)FFMAX(begin - pos, 0);
+		const int keep = (int)FFMAX(end - begin, 0);
+
+		if (skip > 0 && keep > 0) {
+			const int bps = av_get_bytes_per_sample(fmt);
+			memmove(buffer, buffer + (size_t)skip * bps, (size_t)keep * bps);
+		}
+		pos += nr_samples;
+		nr_written += keep;
+
+		if (!inner.commit(keep))
+			return false;
+
+		return pos < to;
+	}
+};
+
+// Return false if the sink asked to stop decoding
+static bool convert_frame(struct SwrContext *swr, AVCodecContext *codec,
+			  AVFrame *frame, sample_sink & sink, bool flush)
 {
 	int nr_samples;
 	s64 delay;
@@ -159,9 +362,9 @@ static void convert_frame(struct SwrContext *swr, AVCodecContext *codec,
 	nr_samples = av_rescale_rnd(delay + (flush ? 0 : frame->nb_samples),
 				    WAVE_SAMPLE_RATE, codec->sample_rate,
 				    AV_ROUND_UP);
-    if (nr_samples <= 0) return;
+    if (nr_samples <= 0) return true;
 
-	av_samples_alloc(&buffer, NULL, 1, nr_samples, AV_SAMPLE_FMT_S16, 0);
+	buffer = sink.reserve(nr_samples);
 
 	/*
 	 * !flush is used to check if we are flushing any remaining
@@ -171,12 +374,49 @@ static void convert_frame(struct SwrContext *swr, AVCodecContext *codec,
 				 !flush ? (const u8 **)frame->data : NULL,
 				 !flush ? frame->nb_samples : 0);
 
-    if (nr_samples > 0) {
-        size_t old_size = data.size();
-        data.resize(old_size + nr_samples);
-        memcpy(data.data() + old_size, buffer, nr_samples * sizeof(s16));
-    }
-	av_freep(&buffer);
+	return sink.commit(nr_samples);
+}
+
+/*
+ * Receive and convert every frame the decoder has ready, a single packet
+ * can produce several frames and draining at EOF produces the rest.
+ * With frame threading the errors of a packet show up here: a corrupt
+ * frame is dropped and decoding goes on, any other error is returned.
+ * Return 0 once the decoder needs more input (or is fully drained),
+ * 1 if the sink stopped decoding, negative on error.
+ */
+static int receive_frames(AVCodecContext *codec, AVFrame *frame, struct SwrContext *swr,
+			  window_sink & window, const AVStream *stream, s64 start_time,
+			  s64 & nr_frames)
+{
+	int err;
+
+	while (true) {
+		err = avcodec_receive_frame(codec, frame);
+		if (err == AVERROR(EAGAIN) || err == AVERROR_EOF)
+			return 0;
+		if (err == AVERROR_INVALIDDATA) {
+			LOG("decode_audio: skipping invalid frame\n");
+			continue;
+		}
+		if (err < 0)
+			return err;
+
+		if (!window.positioned) {
+			const bool ok = window.set_position(frame, stream, start_time);
+			LOG("decode_audio: first frame at sample %lld\n", (long long)window.pos);
+			if (!ok) {
+				av_frame_unref(frame);
+				return 1;
+			}
+		}
+
+		const bool ok = convert_frame(swr, codec, frame, window, false);
+		av_frame_unref(frame);
+		nr_frames++;
+		if (!ok)
+			return 1;
+	}
 }
 
 static bool is_audio_stream(const AVStream *stream)
@@ -187,12 +427,13 @@ static bool is_audio_stream(const AVStream *stream)
 	return false;
 }
 
-// Return non zero on error, 0 on success
-// audio_buffer: input memory
-// data: decoded output audio data
-static int decode_audio(struct audio_buffer *audio_buf, std::vector<s16> & data)
+// Return non zero on error, also after part of the audio was output, 0 on success (also when the sink stopped decoding early)
+// in: input file
+// sink: receives the decoded output audio data
+// t_from, t_to: time window in seconds to decode, t_to < 0 decodes until the end
+static int decode_audio(struct audio_input *in, sample_sink & sink, double t_from = 0.0, double t_to = -1.0)
 {
-    LOG("decode_audio: input size: %d\n", audio_buf->size);
+    LOG("decode_audio: input size: %lld\n", (long long)in->size);
 	AVFormatContext *fmt_ctx;
 	AVIOContext *avio_ctx;
 	AVStream *stream;
@@ -201,6 +442,7 @@ static int decode_audio(struct audio_buffer *audio_buf, std::vector<s16> & data)
 	AVFrame *frame;
 	struct SwrContext *swr;
 	u8 *avio_ctx_buffer;
+	int avio_ctx_buffer_size = ffmpegAvioBufSz ? atoi(ffmpegAvioBufSz) : AVIO_CTX_BUF_SZ;
 	unsigned int i;
 	int stream_index = -1;
 	int err;
@@ -208,9 +450,11 @@ static int decode_audio(struct audio_buffer *audio_buf, std::vector<s16> & data)
     char errbuff[errbuffsize];
 
     fmt_ctx = avformat_alloc_context();
-    avio_ctx_buffer = (u8*)av_malloc(AVIO_CTX_BUF_SZ);
-    LOG("Creating an avio context: AVIO_CTX_BUF_SZ=%d\n", AVIO_CTX_BUF_SZ);
-    avio_ctx = avio_alloc_context(avio_ctx_buffer, AVIO_CTX_BUF_SZ, 0, audio_buf, &read_packet, NULL, NULL);
+    if (avio_ctx_buffer_size <= 0)
+        avio_ctx_buffer_size = AVIO_CTX_BUF_SZ;
+    avio_ctx_buffer = (u8*)av_malloc(avio_ctx_buffer_size);
+    LOG("Creating an avio context: buffer size=%d\n", avio_ctx_buffer_size);
+    avio_ctx = avio_alloc_context(avio_ctx_buffer, avio_ctx_buffer_size, 0, in, &read_packet, NULL, &seek_packet);
 	fmt_ctx->pb = avio_ctx;
 
     // open the input stream and read header
@@ -238,10 +482,20 @@ static int decode_audio(struct audio_buffer *audio_buf, std::vector<s16> & data)
 		return -1;
 	}
 
+	/* let the demuxer skip the packets of the other streams (e.g. video) */
+	for (i = 0; i < fmt_ctx->nb_streams; i++) {
+		if ((int)i != stream_index)
+			fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+	}
+
 	stream = fmt_ctx->streams[stream_index];
 	codec = avcodec_alloc_context3(
 			avcodec_find_decoder(stream->codecpar->codec_id));
 	avcodec_parameters_to_context(codec, stream->codecpar);
+	codec->pkt_timebase = stream->time_base;
+	/* use frame/slice threading for the codecs that support it */
+	codec->thread_count = ffmpegThreads ? atoi(ffmpegThreads) : 0;
+	codec->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
 	err = avcodec_open2(codec, avcodec_find_decoder(codec->codec_id),
 							NULL);
 	if (err) {
@@ -264,7 +518,7 @@ static int decode_audio(struct audio_buffer *audio_buf, std::vector<s16> & data)
 	/* Convert it into 16khz Mono */
 	av_opt_set_chlayout(swr, "out_chlayout", &out_ch_layout, 0);
 	av_opt_set_int(swr, "out_sample_rate", WAVE_SAMPLE_RATE, 0);
-	av_opt_set_sample_fmt(swr, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+	av_opt_set_sample_fmt(swr, "out_sample_fmt", sink.fmt, 0);
 #else
 	av_opt_set_int(swr, "in_channel_count", codec->channels, 0);
 	av_opt_set_int(swr, "out_channel_count", 1, 0);
@@ -273,7 +527,7 @@ static int decode_audio(struct audio_buffer *audio_buf, std::vector<s16> & data)
 	av_opt_set_int(swr, "in_sample_rate", codec->sample_rate, 0);
 	av_opt_set_int(swr, "out_sample_rate", WAVE_SAMPLE_RATE, 0);
 	av_opt_set_sample_fmt(swr, "in_sample_fmt", codec->sample_fmt, 0);
-	av_opt_set_sample_fmt(swr, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+	av_opt_set_sample_fmt(swr, "out_sample_fmt", sink.fmt, 0);
 #endif
 
 	swr_init(swr);
@@ -293,19 +547,69 @@ static int decode_audio(struct audio_buffer *audio_buf, std::vector<s16> & data)
 		return -1;
 	}
 
-	/* iterate through frames */
-	data.clear();
-	while (av_read_frame(fmt_ctx, packet) >= 0) {
-		avcodec_send_packet(codec, packet);
+	/* jump close to the start of the window instead of decoding from byte 0 */
+	const s64 start_time = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+	if (t_from > 0) {
+		const s64 ts = start_time + (s64)(t_from / av_q2d(stream->time_base));
+		err = av_seek_frame(fmt_ctx, stream_index, ts, AVSEEK_FLAG_BACKWARD);
+		if (err < 0) {
+			LOG("Could not seek to %.3f s, decoding from the start: %s\n", t_from, av_make_error_string(errbuff, errbuffsize, err));
+		}
+		avcodec_flush_buffers(codec);
+	}
 
-		err = avcodec_receive_frame(codec, frame);
-		if (err == AVERROR(EAGAIN))
-			continue;
+	window_sink window(sink,
+			   (s64)(t_from * WAVE_SAMPLE_RATE),
+			   t_to >= 0 ? (s64)(t_to * WAVE_SAMPLE_RATE) : INT64_MAX);
+	const auto t_start = std::chrono::steady_clock::now();
+	s64 nr_frames = 0;
+
+	/* size the output up front from the stream duration */
+	double t_duration = -1.0;
+	if (stream->duration != AV_NOPTS_VALUE)
+		t_duration = stream->duration * av_q2d(stream->time_base);
+	else if (fmt_ctx->duration != AV_NOPTS_VALUE)
+		t_duration = (double)fmt_ctx->duration / AV_TIME_BASE;
+	if (t_duration > 0) {
+		if (t_to >= 0)
+			t_duration = FFMIN(t_duration, t_to);
+		/* one second of slack for the resampler and rounding */
+		window.prepare((s64)((t_duration - t_from + 1.0) * WAVE_SAMPLE_RATE));
+	}
+
+	/* iterate through packets, a demuxer may still return some of a discarded stream */
+	int ret = 0;
+	while (ret == 0 && av_read_frame(fmt_ctx, packet) >= 0) {
+		if (packet->stream_index == stream_index) {
+			err = avcodec_send_packet(codec, packet);
+			if (err < 0 && err != AVERROR(EAGAIN)) {
+				LOG("decode_audio: skipping packet: %s\n", av_make_error_string(errbuff, errbuffsize, err));
+			} else {
+				ret = receive_frames(codec, frame, swr, window, stream, start_time, nr_frames);
+			}
+		}
+		av_packet_unref(packet);
+	}
 
-		convert_frame(swr, codec, frame, data, false);
+	/* Drain the frames still buffered in the decoder... */
+	if (ret == 0) {
+		avcodec_send_packet(codec, NULL);
+		ret = receive_frames(codec, frame, swr, window, stream, start_time, nr_frames);
 	}
-	/* Flush any remaining conversion buffers... */
-	convert_frame(swr, codec, frame, data, true);
+	/* ...and flush any remaining conversion buffers */
+	if (ret == 0)
+		convert_frame(swr, codec, frame, window, true);
+	if (ret == 1)
+		LOG("decode_audio: stopped by the consumer\n");
+	if (ret < 0)
+		LOG("decode_audio: decoding error: %s\n", av_make_error_string(errbuff, errbuffsize, ret));
+
+	const double t_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+	const double t_audio = (double)window.nr_written / WAVE_SAMPLE_RATE;
+	LOG("decode_audio: decoded %.1f s of audio in %.3f s (%.1f s of audio per second, %d threads)\n",
+	    t_audio, t_elapsed, t_elapsed > 0 ? t_audio / t_elapsed : 0.0, codec->thread_count);
+	LOG("decode_audio: %lld frames, %lld output buffer allocations (%.1f per decoded hour)\n",
+	    (long long)nr_frames, (long long)sink.nr_allocs, t_audio > 0 ? sink.nr_allocs * 3600.0 / t_audio : 0.0);
 
 	av_packet_free(&packet);
 	av_frame_free(&frame);
@@ -320,7 +624,7 @@ static int decode_audio(struct audio_buffer *audio_buf, std::vector<s16> & data)
 		av_freep(&avio_ctx);
 	}
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 // in mem decoding/conversion/resampling:
@@ -329,30 +633,19 @@ static int decode_audio(struct audio_buffer *audio_buf, std::vector<s16> & data)
 // return 0 on success
 int ffmpeg_decode_audio(const std::string &ifname, std::vector<uint8_t>& owav_data) {
     LOG("ffmpeg_decode_audio: %s\n", ifname.c_str());
-    int ifd = open(ifname.c_str(), O_RDONLY);
-    if (ifd == -1) {
-        fprintf(stderr, "Couldn't open input file %s\n", ifname.c_str());
-        return -1;
-    }
-    u8 *ibuf = NULL;
-    size_t ibuf_size;
-    int err = map_file(ifd, &ibuf, &ibuf_size);
+    struct audio_input input;
+    int err = open_input(ifname, &input);
     if (err) {
-        LOG("Couldn't map input file %s\n", ifname.c_str());
-        close(ifd);
         return err;
     }
-    LOG("Mapped input file size: %zu\n", ibuf_size);
-    struct audio_buffer inaudio_buf;
-    inaudio_buf.ptr = ibuf;
-    inaudio_buf.size = (int)ibuf_size;
+    LOG("Input file size: %lld\n", (long long)input.size);
 
     std::vector<s16> odata;
+    vector_sink<s16> osink(odata, AV_SAMPLE_FMT_S16);
 
-    err = decode_audio(&inaudio_buf, odata);
+    err = decode_audio(&input, osink);
     LOG("decode_audio returned %d \n", err);
-    munmap(ibuf, ibuf_size);
-    close(ifd);
+    close(input.fd);
 
     if (err != 0) {
         LOG("decode_audio failed\n");
@@ -371,3 +664,55 @@ int ffmpeg_decode_audio(const std::string &ifname, std::vector<uint8_t>& owav_da
 
     return 0;
 }
+
+// in mem decoding/conversion/resampling straight to float, without the intermediate wav file:
+// ifname: input file path
+// opcmf32: 16khz mono samples, as read_audio_data() would return them
+// return 0 on success
+int ffmpeg_decode_audio_f32(const std::string &ifname, std::vector<float>& opcmf32) {
+    LOG("ffmpeg_decode_audio_f32: %s\n", ifname.c_str());
+    struct audio_input input;
+    int err = open_input(ifname, &input);
+    if (err) {
+        return err;
+    }
+    LOG("Input file size: %lld\n", (long long)input.size);
+
+    opcmf32.clear();
+    vector_sink<float> osink(opcmf32, AV_SAMPLE_FMT_FLT);
+
+    err = decode_audio(&input, osink);
+    LOG("decode_audio returned %d \n", err);
+    close(input.fd);
+
+    if (err != 0) {
+        LOG("decode_audio failed\n");
+        return err;
+    }
+    LOG("decode_audio output size: %zu\n", opcmf32.size());
+
+    return 0;
+}
+
+// streaming decoding/conversion/resampling:
+// ifname: input file path
+// out: receives 16khz mono float samples as they are decoded, decoding stops early if it returns false
+// t_from, t_to: time window in seconds, the first sample pushed is the one at t_from
+// return 0 on success
+int ffmpeg_decode_audio_stream(const std::string &ifname, audio_stream_sink & out, double t_from, double t_to) {
+    LOG("ffmpeg_decode_audio_stream: %s\n", ifname.c_str());
+    struct audio_input input;
+    int err = open_input(ifname, &input);
+    if (err) {
+        return err;
+    }
+    LOG("Input file size: %lld\n", (long long)input.size);
+
+    stream_sink osink(out);
+
+    err = decode_audio(&input, osink, t_from, t_to);
+    LOG("decode_audio returned %d \n", err);
+    close(input.fd);
+
+    return err;
+}
@@ -0,0 +1,51 @@
+#include "fuzzy-match.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+bool fuzzy_matcher::init(const std::string & word, int max_edits) {
+    if (word.empty() || word.size() > 64 || (int) word.size() <= max_edits) {
+        return false;
+    }
+
+    this->word      = word;
+    this->max_edits = std::max(0, max_edits);
+
+    std::fill(peq, peq + 256, 0ull);
+    for (size_t i = 0; i < word.size(); ++i) {
+        peq[(unsigned char) word[i]] |= 1ull << i;
+    }
+
+    return true;
+}
+
+size_t fuzzy_matcher::match_start(const char * text, size_t end) const {
+    const int m = (int) word.size();
+    const int n = (int) std::min(end, (size_t) (m + max_edits));
+
+    // d[i] is the edit distance between the last j characters before end and the last i characters of the word,
+    // the columns run over j
+    std::vector<int> d(m + 1);
+    for (int i = 0; i <= m; ++i) {
+        d[i] = i;
+    }
+
+    int best_j = 0;
+    int best_d = d[m];
+    for (int j = 1; j <= n; ++j) {
+        const char c = text[end - j];
+        int diag = d[0];
+        d[0] = j;
+        for (int i = 1; i <= m; ++i) {
+            const int up = d[i];
+            d[i] = std::min(std::min(d[i - 1], up) + 1, diag + (word[m - i] == c ? 0 : 1));
+            diag = up;
+        }
+        if (d[m] < best_d || (d[m] == best_d && std::abs(j - m) < std::abs(best_j - m))) {
+            best_d = d[m];
+            best_j = j;
+        }
+    }
+
+    return end - best_j;
+}
@@ -0,0 +1,190 @@
+#include "keyword-decode.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+
+//
+// Keyword boost
+//
+
+bool keyword_boost_init(struct whisper_context * ctx, const std::string & word, float boost, keyword_boost & kb) {
+    kb = keyword_boost();
+    kb.boost = boost;
+
+    std::string capitalized = word;
+    std::string upper       = word;
+    if (!word.empty()) {
+        capitalized[0] = (char) std::toupper((unsigned char) word[0]);
+    }
+    std::transform(upper.begin(), upper.end(), upper.begin(), [](char c) { return (char) std::toupper((unsigned char) c); });
+
+    const std::string spellings[] = {
+        " " + word, " " + capitalized, " " + upper,
+        word,       capitalized,       upper,
+    };
+
+    for (const std::string & spelling : spellings) {
+        std::vector<whisper_token> tokens(spelling.size() + 8);
+        const int n_tokens = whisper_tokenize(ctx, spelling.c_str(), tokens.data(), (int) tokens.size());
+        if (n_tokens <= 0) {
+            continue;
+        }
+        tokens.resize(n_tokens);
+        if (std::find(kb.spellings.begin(), kb.spellings.end(), tokens) == kb.spellings.end()) {
+            kb.spellings.push_back(tokens);
+        }
+    }
+
+    if (kb.spellings.empty()) {
+        fprintf(stderr, "%s: failed to tokenize '%s'\n", __func__, word.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void keyword_boost_logits_filter(
+        struct whisper_context * /*ctx*/,
+          struct whisper_state * /*state*/,
+      const whisper_token_data * tokens,
+                           int   n_tokens,
+                         float * logits,
+                          void * user_data) {
+    const keyword_boost & kb = *(const keyword_boost *) user_data;
+
+    // spellings can share a token (" K" of " Kubernetes" and " KUBERNETES"), it is boosted once
+    std::vector<whisper_token> boosted;
+    boosted.reserve(2 * kb.spellings.size());
+
+    for (const std::vector<whisper_token> & spelling : kb.spellings) {
+        const int n_spelling = (int) spelling.size();
+
+        // the longest proper prefix of the spelling the decoded tokens end with
+        int n_matched = 0;
+        for (int k = std::min(n_spelling - 1, n_tokens); k > 0; --k) {
+            bool match = true;
+            for (int i = 0; i < k && match; ++i) {
+                match = tokens[n_tokens - k + i].id == spelling[i];
+            }
+            if (match) {
+                n_matched = k;
+                break;
+            }
+        }
+
+        boosted.push_back(spelling[0]);
+        if (n_matched > 0) {
+            boosted.push_back(spelling[n_matched]);
+        }
+    }
+
+    std::sort(boosted.begin(), boosted.end());
+    boosted.erase(std::unique(boosted.begin(), boosted.end()), boosted.end());
+    for (whisper_token token : boosted) {
+        logits[token] += kb.boost;
+    }
+}
+
+//
+// Keyword alignment
+//
+
+bool keyword_align_init(struct whisper_context * ctx, const std::string & word, float threshold, keyword_align & ka) {
+    ka = keyword_align();
+    ka.threshold = threshold;
+
+    std::string capitalized = word;
+    if (!word.empty()) {
+        capitalized[0] = (char) std::toupper((unsigned char) word[0]);
+    }
+
+    const std::string spellings[] = { " " + word, " " + capitalized };
+    for (const std::string & spelling : spellings) {
+        std::vector<whisper_token> tokens(spelling.size() + 8);
+        const int n_tokens = whisper_tokenize(ctx, spelling.c_str(), tokens.data(), (int) tokens.size());
+        if (n_tokens <= 0) {
+            continue;
+        }
+        tokens.resize(n_tokens);
+        if (std::find(ka.spellings.begin(), ka.spellings.end(), tokens) == ka.spellings.end()) {
+            ka.spellings.push_back(tokens);
+        }
+    }
+
+    if (ka.spellings.empty()) {
+        fprintf(stderr, "%s: failed to tokenize '%s'\n", __func__, word.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void keyword_align_candidates(struct whisper_context * ctx, struct whisper_state * state, int n_ts, int spacing, std::vector<int> & ts) {
+    const float * logits = whisper_get_logits_from_state(state) + whisper_token_beg(ctx);
+
+    std::vector<int> order(n_ts + 1);
+    for (int i = 0; i <= n_ts; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [logits](int a, int b) { return logits[a] > logits[b]; });
+
+    // non-max suppression: a timestamp is kept unless a better one was kept within spacing steps
+    std::vector<bool> suppressed(n_ts + 1, false);
+    ts.clear();
+    for (int i : order) {
+        if (suppressed[i]) {
+            continue;
+        }
+        ts.push_back(i);
+        for (int j = std::max(0, i - spacing); j <= std::min(n_ts, i + spacing); ++j) {
+            suppressed[j] = true;
+        }
+    }
+}
+
+// Decode token at n_past and return the logit of the best next token, NAN on failure
+static float keyword_align_step(struct whisper_context * ctx, struct whisper_state * state, whisper_token token, int n_past, int n_threads, int & n_decode) {
+    n_decode++;
+    if (whisper_decode_with_state(ctx, state, &token, 1, n_past, n_threads) != 0) {
+        return NAN;
+    }
+    const float * logits = whisper_get_logits_from_state(state);
+    return *std::max_element(logits, logits + whisper_n_vocab(ctx));
+}
+
+float keyword_align_score(
+        struct whisper_context * ctx,
+          struct whisper_state * state,
+           const keyword_align & ka,
+                           int   n_past,
+                           int   ts,
+                           int   n_threads,
+                           int & n_decode) {
+    // the first step after the timestamp is shared by all spellings
+    const float max_first = keyword_align_step(ctx, state, whisper_token_beg(ctx) + ts, n_past, n_threads, n_decode);
+    if (std::isnan(max_first)) {
+        return -INFINITY;
+    }
+    std::vector<float> first(ka.spellings.size());
+    for (size_t k = 0; k < ka.spellings.size(); ++k) {
+        first[k] = whisper_get_logits_from_state(state)[ka.spellings[k][0]] - max_first;
+    }
+
+    float best = -INFINITY;
+    for (size_t k = 0; k < ka.spellings.size(); ++k) {
+        const std::vector<whisper_token> & spelling = ka.spellings[k];
+        float score = first[k];
+        for (size_t i = 1; i < spelling.size() && score >= ka.threshold; ++i) {
+            const float max_logit = keyword_align_step(ctx, state, spelling[i - 1], n_past + (int) i, n_threads, n_decode);
+            if (std::isnan(max_logit)) {
+                return -INFINITY;
+            }
+            score += whisper_get_logits_from_state(state)[spelling[i]] - max_logit;
+        }
+        best = std::max(best, score);
+    }
+
+    return best;
+}
@@ -0,0 +1,444 @@
+#include "media-cache.h"
+
+#include "whisper.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+// File identity
+//
+
+static uint64_t fnv1a_64(const void * data, size_t n, uint64_t hash = 0xcbf29ce484222325ULL) {
+    const uint8_t * p = (const uint8_t *) data;
+    for (size_t i = 0; i < n; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool media_file_key_init(const std::string & fname, media_file_key & key) {
+    if (fname == "-") {
+        return false;
+    }
+
+    char resolved[PATH_MAX];
+    if (realpath(fname.c_str(), resolved) == nullptr) {
+        return false;
+    }
+
+    const int fd = open(resolved, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        close(fd);
+        return false;
+    }
+
+    key.path     = resolved;
+    key.size     = (uint64_t) sb.st_size;
+    key.mtime_ns = (int64_t) sb.st_mtim.tv_sec * 1000000000LL + sb.st_mtim.tv_nsec;
+
+    // hash the head, middle and tail blocks of the file
+    const size_t block_size = 64 * 1024;
+    std::vector<uint8_t> block(block_size);
+    const uint64_t offsets[3] = {
+        0,
+        key.size > block_size ? key.size / 2 : 0,
+        key.size > block_size ? key.size - block_size : 0,
+    };
+
+    uint64_t hash = fnv1a_64(&key.size, sizeof(key.size));
+    for (uint64_t offset : offsets) {
+        const ssize_t n = pread(fd, block.data(), block.size(), (off_t) offset);
+        if (n < 0) {
+            close(fd);
+            return false;
+        }
+        hash = fnv1a_64(block.data(), (size_t) n, hash);
+    }
+    key.content_hash = hash;
+
+    close(fd);
+
+    return true;
+}
+
+std::string media_cache_path(const std::string & cache_dir, const media_file_key & key, const char * ext) {
+    uint64_t hash = fnv1a_64(key.path.data(), key.path.size());
+    hash = fnv1a_64(&key.size,         sizeof(key.size),         hash);
+    hash = fnv1a_64(&key.mtime_ns,     sizeof(key.mtime_ns),     hash);
+    hash = fnv1a_64(&key.content_hash, sizeof(key.content_hash), hash);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long) hash);
+
+    return cache_dir + "/" + name + ext;
+}
+
+//
+// Decoded PCM cache
+//
+
+static const char     k_pcm_cache_magic[8] = { 'D', 'W', 'P', 'C', 'M', 0, 0, 0 };
+static const uint32_t k_pcm_cache_version  = 1;
+
+struct pcm_cache_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t sample_rate;
+    uint64_t n_samples;
+    uint64_t file_size;
+    int64_t  file_mtime_ns;
+    uint64_t content_hash;
+    uint8_t  reserved[16]; // keeps the samples 64 byte aligned
+};
+
+static_assert(sizeof(pcm_cache_header) == 64, "pcm_cache_header must be 64 bytes");
+
+static void pcm_cache_header_init(pcm_cache_header & hdr, const media_file_key & key, uint64_t n_samples) {
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, k_pcm_cache_magic, sizeof(hdr.magic));
+    hdr.version       = k_pcm_cache_version;
+    hdr.sample_rate   = WHISPER_SAMPLE_RATE;
+    hdr.n_samples     = n_samples;
+    hdr.file_size     = key.size;
+    hdr.file_mtime_ns = key.mtime_ns;
+    hdr.content_hash  = key.content_hash;
+}
+
+bool pcm_cache_map(const std::string & cache_dir, const media_file_key & key, pcm_cache_mapping & mapping) {
+    const std::string path = media_cache_path(cache_dir, key, ".pcm");
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || (size_t) sb.st_size < sizeof(pcm_cache_header)) {
+        close(fd);
+        return false;
+    }
+
+    void * addr = mmap(nullptr, (size_t) sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    pcm_cache_header expected;
+    pcm_cache_header_init(expected, key, 0);
+
+    const pcm_cache_header * hdr = (const pcm_cache_header *) addr;
+    const bool valid =
+        memcmp(hdr->magic, expected.magic, sizeof(hdr->magic)) == 0 &&
+        hdr->version       == expected.version       &&
+        hdr->sample_rate   == expected.sample_rate   &&
+        hdr->file_size     == expected.file_size     &&
+        hdr->file_mtime_ns == expected.file_mtime_ns &&
+        hdr->content_hash  == expected.content_hash  &&
+        sizeof(pcm_cache_header) + hdr->n_samples * sizeof(float) == (uint64_t) sb.st_size;
+
+    if (!valid) {
+        fprintf(stderr, "%s: ignoring stale cache entry %s\n", __func__, path.c_str());
+        munmap(addr, (size_t) sb.st_size);
+        return false;
+    }
+
+    madvise(addr, (size_t) sb.st_size, MADV_SEQUENTIAL);
+
+    mapping.samples   = (const float *) ((const uint8_t *) addr + sizeof(pcm_cache_header));
+    mapping.n_samples = hdr->n_samples;
+    mapping.addr      = addr;
+    mapping.size      = (size_t) sb.st_size;
+
+    return true;
+}
+
+void pcm_cache_unmap(pcm_cache_mapping & mapping) {
+    if (mapping.addr) {
+        munmap(mapping.addr, mapping.size);
+    }
+    mapping = pcm_cache_mapping();
+}
+
+bool pcm_cache_stream(const pcm_cache_mapping & mapping, audio_stream_sink & sink, double t_from, double t_to) {
+    const uint64_t begin = std::min(mapping.n_samples, (uint64_t) (t_from * WHISPER_SAMPLE_RATE));
+    const uint64_t end   = t_to >= 0 ? std::min(mapping.n_samples, (uint64_t) (t_to * WHISPER_SAMPLE_RATE)) : mapping.n_samples;
+
+    // push in blocks of one second so the consumer can cancel early
+    for (uint64_t pos = begin; pos < end; pos += WHISPER_SAMPLE_RATE) {
+        const size_t n = (size_t) std::min<uint64_t>(WHISPER_SAMPLE_RATE, end - pos);
+        if (!sink.push(mapping.samples + pos, n)) {
+            break;
+        }
+    }
+    sink.close();
+
+    return true;
+}
+
+pcm_cache_writer::pcm_cache_writer(audio_stream_sink & out, double t_from, double t_to) :
+    out(out),
+    from((int64_t) (t_from * WHISPER_SAMPLE_RATE)),
+    to(t_to >= 0 ? (int64_t) (t_to * WHISPER_SAMPLE_RATE) : INT64_MAX) {
+}
+
+pcm_cache_writer::~pcm_cache_writer() {
+    if (file) {
+        finish(false);
+    }
+}
+
+bool pcm_cache_writer::open(const std::string & cache_dir, const media_file_key & key) {
+    this->key = key;
+    path      = media_cache_path(cache_dir, key, ".pcm");
+    path_tmp  = path + ".tmp." + std::to_string(getpid());
+
+    file = fopen(path_tmp.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "%s: failed to create cache entry %s\n", __func__, path_tmp.c_str());
+        return false;
+    }
+
+    // placeholder, rewritten with the sample count by finish()
+    pcm_cache_header hdr;
+    pcm_cache_header_init(hdr, key, 0);
+    fwrite(&hdr, sizeof(hdr), 1, file);
+
+    return true;
+}
+
+bool pcm_cache_writer::push(const float * data, size_t n) {
+    if (file && fwrite(data, sizeof(float), n, file) != n) {
+        fprintf(stderr, "%s: failed to write cache entry %s\n", __func__, path_tmp.c_str());
+        fclose(file);
+        file = nullptr;
+        remove(path_tmp.c_str());
+    }
+
+    const int64_t begin = std::max(pos, from);
+    const int64_t end   = std::min(pos + (int64_t) n, to);
+    pos += (int64_t) n;
+
+    if (out_open && end > begin) {
+        out_open = out.push(data + (begin - (pos - (int64_t) n)), (size_t) (end - begin));
+    }
+    if (out_open && pos >= to) {
+        out.close();
+        out_open = false;
+    }
+
+    // keep decoding for the cache after the consumer is done
+    return file != nullptr || out_open;
+}
+
+void pcm_cache_writer::close() {
+    if (out_open) {
+        out.close();
+        out_open = false;
+    }
+}
+
+bool pcm_cache_writer::finish(bool ok) {
+    if (!file) {
+        return false;
+    }
+
+    if (ok) {
+        pcm_cache_header hdr;
+        pcm_cache_header_init(hdr, key, (uint64_t) pos);
+        ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&hdr, sizeof(hdr), 1, file) == 1;
+    }
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+
+    // rename is atomic, concurrent jobs either see the complete entry or none
+    if (!ok || rename(path_tmp.c_str(), path.c_str()) != 0) {
+        remove(path_tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool read_audio_data_cached(const std::string & fname, const std::string & cache_dir, audio_stream_sink & sink, double t_from, double t_to) {
+    media_file_key key;
+    if (!media_file_key_init(fname, key)) {
+        return read_audio_data_stream(fname, sink, t_from, t_to);
+    }
+
+    pcm_cache_mapping mapping;
+    if (pcm_cache_map(cache_dir, key, mapping)) {
+        const bool ok = pcm_cache_stream(mapping, sink, t_from, t_to);
+        pcm_cache_unmap(mapping);
+        return ok;
+    }
+
+    pcm_cache_writer writer(sink, t_from, t_to);
+    if (!writer.open(cache_dir, key)) {
+        return read_audio_data_stream(fname, sink, t_from, t_to);
+    }
+
+    const bool ok = read_audio_data_stream(fname, writer);
+    writer.finish(ok);
+
+    return ok;
+}
+
+//
+// Transcript cache
+//
+
+static const char     k_transcript_cache_magic[8] = { 'D', 'W', 'T', 'R', 'S', 0, 0, 0 };
+static const uint32_t k_transcript_cache_version  = 2;
+
+struct transcript_cache_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t complete;
+    uint64_t file_size;
+    int64_t  file_mtime_ns;
+    uint64_t content_hash;
+    uint64_t config_hash;
+    double   t_end;
+    uint64_t n_segments;
+};
+
+struct transcript_cache_segment {
+    double   t_offset;
+    uint32_t n_tokens;
+    uint32_t n_chars;
+    // followed by n_tokens transcript_token and n_chars of cleaned text
+};
+
+static_assert(sizeof(transcript_cache_header)  == 64, "transcript_cache_header must be 64 bytes");
+static_assert(sizeof(transcript_cache_segment) == 16, "transcript_cache_segment must be 16 bytes");
+static_assert(sizeof(transcript_token)         == 24, "transcript_token must be 24 bytes");
+
+static std::string transcript_cache_path(const std::string & cache_dir, const media_file_key & key, uint64_t config_hash) {
+    char ext[32];
+    snprintf(ext, sizeof(ext), ".%016llx.trs", (unsigned long long) config_hash);
+
+    return media_cache_path(cache_dir, key, ext);
+}
+
+bool transcript_cache_load(const std::string & cache_dir, const media_file_key & key, const std::string & config, transcript & tr) {
+    const uint64_t config_hash = fnv1a_64(config.data(), config.size());
+    const std::string path = transcript_cache_path(cache_dir, key, config_hash);
+
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    // the counts of a truncated or corrupt entry are checked against the bytes left before anything is allocated
+    struct stat sb;
+    uint64_t n_left = fstat(fileno(file), &sb) == 0 ? (uint64_t) sb.st_size : 0;
+
+    transcript_cache_header hdr;
+    bool ok = n_left >= sizeof(hdr) && fread(&hdr, sizeof(hdr), 1, file) == 1 &&
+        memcmp(hdr.magic, k_transcript_cache_magic, sizeof(hdr.magic)) == 0 &&
+        hdr.version       == k_transcript_cache_version &&
+        hdr.file_size     == key.size &&
+        hdr.file_mtime_ns == key.mtime_ns &&
+        hdr.content_hash  == key.content_hash &&
+        hdr.config_hash   == config_hash;
+    n_left -= ok ? sizeof(hdr) : 0;
+    ok = ok && hdr.n_segments <= n_left / sizeof(transcript_cache_segment);
+
+    transcript result;
+    result.segments.resize(ok ? hdr.n_segments : 0);
+    for (transcript_segment & segment : result.segments) {
+        transcript_cache_segment seg_hdr;
+        if (fread(&seg_hdr, sizeof(seg_hdr), 1, file) != 1) {
+            ok = false;
+            break;
+        }
+        n_left -= sizeof(seg_hdr);
+        const uint64_t n_bytes = (uint64_t) seg_hdr.n_tokens * sizeof(transcript_token) + seg_hdr.n_chars;
+        if (n_bytes > n_left) {
+            ok = false;
+            break;
+        }
+        n_left -= n_bytes;
+        segment.t_offset = seg_hdr.t_offset;
+        segment.tokens.resize(seg_hdr.n_tokens);
+        segment.cleaned.resize(seg_hdr.n_chars);
+        if (fread(segment.tokens.data(), sizeof(transcript_token), seg_hdr.n_tokens, file) != seg_hdr.n_tokens ||
+            fread(&segment.cleaned[0], 1, seg_hdr.n_chars, file) != seg_hdr.n_chars) {
+            ok = false;
+            break;
+        }
+    }
+    fclose(file);
+
+    if (!ok) {
+        fprintf(stderr, "%s: ignoring invalid cache entry %s\n", __func__, path.c_str());
+        return false;
+    }
+
+    result.t_end    = hdr.t_end;
+    result.complete = hdr.complete != 0;
+    tr = std::move(result);
+
+    return true;
+}
+
+bool transcript_cache_save(const std::string & cache_dir, const media_file_key & key, const std::string & config, const transcript & tr) {
+    const uint64_t config_hash = fnv1a_64(config.data(), config.size());
+    const std::string path     = transcript_cache_path(cache_dir, key, config_hash);
+    const std::string path_tmp = path + ".tmp." + std::to_string(getpid());
+
+    FILE * file = fopen(path_tmp.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "%s: failed to create cache entry %s\n", __func__, path_tmp.c_str());
+        return false;
+    }
+
+    transcript_cache_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, k_transcript_cache_magic, sizeof(hdr.magic));
+    hdr.version       = k_transcript_cache_version;
+    hdr.complete      = tr.complete ? 1 : 0;
+    hdr.file_size     = key.size;
+    hdr.file_mtime_ns = key.mtime_ns;
+    hdr.content_hash  = key.content_hash;
+    hdr.config_hash   = config_hash;
+    hdr.t_end         = tr.t_end;
+    hdr.n_segments    = std::min(tr.segments.size(), tr.n_before_gap);
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, file) == 1;
+    for (size_t i = 0; ok && i < hdr.n_segments; ++i) {
+        const transcript_segment & segment = tr.segments[i];
+        transcript_cache_segment seg_hdr;
+        seg_hdr.t_offset = segment.t_offset;
+        seg_hdr.n_tokens = (uint32_t) segment.tokens.size();
+        seg_hdr.n_chars  = (uint32_t) segment.cleaned.size();
+        ok = fwrite(&seg_hdr, sizeof(seg_hdr), 1, file) == 1 &&
+             fwrite(segment.tokens.data(), sizeof(transcript_token), segment.tokens.size(), file) == segment.tokens.size() &&
+             fwrite(segment.cleaned.data(), 1, segment.cleaned.size(), file) == segment.cleaned.size();
+    }
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || rename(path_tmp.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "%s: failed to write cache entry %s\n", __func__, path.c_str());
+        remove(path_tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
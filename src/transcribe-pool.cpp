@@ -0,0 +1,611 @@
+#include "transcribe-pool.h"
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Silence inserted between the segments of a packed job
+static const int64_t k_pack_gap_samples = WHISPER_SAMPLE_RATE / 10;
+
+// The encoder produces one frame per 20 ms of audio
+static const int k_samples_per_frame = WHISPER_SAMPLE_RATE / 50;
+
+// Probability of the detected language needed to pin it
+static const float k_pin_language_p = 0.5f;
+
+// Jobs detected without reaching k_pin_language_p before the most likely language over all of them is pinned
+static const int k_pin_language_max_unsure = 3;
+
+// Minimum distance in 20 ms steps between the starts of the target tried by forced alignment, besides the piece starts
+static const int k_align_spacing = 25;
+
+// Frames added to an adaptive audio_ctx, so the end of the job isn't cut off
+static const int k_audio_ctx_margin = 64;
+
+int transcribe_job::piece_at(double t) const {
+    const int64_t pos = (int64_t) std::llround(t * WHISPER_SAMPLE_RATE);
+    auto it = std::upper_bound(pieces.begin(), pieces.end(), pos,
+        [](int64_t p, const transcribe_piece & piece) { return p < piece.packed; });
+    if (it == pieces.begin()) {
+        return 0;
+    }
+
+    // times in the silence between two pieces snap to the nearer one
+    auto prev = it - 1;
+    const int64_t prev_end = prev->packed + prev->length;
+    if (pos > prev_end && it != pieces.end() && it->packed - pos < pos - prev_end) {
+        return (int) (it - pieces.begin());
+    }
+
+    return (int) (prev - pieces.begin());
+}
+
+double transcribe_job::source_time(double t) const {
+    if (pieces.empty()) {
+        return t_offset + t;
+    }
+
+    const transcribe_piece & piece = pieces[piece_at(t)];
+    const int64_t pos = (int64_t) std::llround(t * WHISPER_SAMPLE_RATE) - piece.packed;
+
+    return (double) (piece.start + std::max<int64_t>(0, std::min(pos, piece.length))) / WHISPER_SAMPLE_RATE;
+}
+
+//
+// transcribe_packer
+//
+
+bool transcribe_packer::add(speech_segment && segment, transcribe_job & full) {
+    bool flushed = false;
+    if (!pending.pieces.empty() &&
+        ((int64_t) (pending.samples.size() + k_pack_gap_samples + segment.samples.size()) > max_samples ||
+         segment.end() - pending.pieces[0].start > 2 * max_samples)) {
+        flushed = flush(full);
+    }
+
+    if (pending.pieces.empty()) {
+        pending.t_offset = (double) segment.start / WHISPER_SAMPLE_RATE;
+    } else {
+        pending.samples.insert(pending.samples.end(), k_pack_gap_samples, 0.0f);
+    }
+    pending.pieces.push_back({ (int64_t) pending.samples.size(), segment.start, (int64_t) segment.samples.size() });
+    pending.samples.insert(pending.samples.end(), segment.samples.begin(), segment.samples.end());
+
+    return flushed;
+}
+
+bool transcribe_packer::flush(transcribe_job & job) {
+    if (pending.pieces.empty()) {
+        return false;
+    }
+
+    job = std::move(pending);
+    pending = transcribe_job();
+
+    // a single segment needs no mapping
+    if (job.pieces.size() == 1) {
+        job.pieces.clear();
+    }
+
+    return true;
+}
+
+bool transcribe_packer::flush_stale(int64_t position, transcribe_job & job) {
+    if (pending.pieces.empty() || position - pending.pieces[0].start <= 2 * max_samples) {
+        return false;
+    }
+    return flush(job);
+}
+
+int64_t transcribe_packer::pending_start() const {
+    return pending.pieces.empty() ? INT64_MAX : pending.pieces[0].start;
+}
+
+// Convert whisper segment i_segment of the last run on state and append it to job.segments
+// The segments of a packed job are moved from packed time to file time and split where whisper ran from
+// one piece into the next: pieces can be far apart in the file, their words must not match the target together
+static void append_segment(
+        struct whisper_context * ctx,
+          struct whisper_state * state,
+                           int   i_segment,
+           const cleaned_vocab * vocab,
+                transcribe_job & job) {
+    if (job.pieces.empty()) {
+        job.segments.emplace_back();
+        transcript_segment_from_whisper(ctx, state, i_segment, job.t_offset, job.segments.back(), vocab);
+        return;
+    }
+
+    // tokens are converted with the job's t_offset, so t0 is relative to the start of the packed samples
+    transcript_segment packed;
+    transcript_segment_from_whisper(ctx, state, i_segment, job.t_offset, packed, vocab);
+    if (packed.tokens.empty()) {
+        packed.t_offset = job.source_time(0.0);
+        job.segments.push_back(std::move(packed));
+        return;
+    }
+
+    size_t i_begin = 0;
+    while (i_begin < packed.tokens.size()) {
+        const int i_piece = job.piece_at(packed.tokens[i_begin].t0 * 0.01);
+        size_t i_end = i_begin + 1;
+        while (i_end < packed.tokens.size() && job.piece_at(packed.tokens[i_end].t0 * 0.01) == i_piece) {
+            ++i_end;
+        }
+
+        job.segments.emplace_back();
+        transcript_segment & segment = job.segments.back();
+        const uint32_t text_begin = packed.text_begin((int) i_begin);
+        segment.t_offset = job.source_time(packed.tokens[i_begin].t0 * 0.01);
+        segment.cleaned  = packed.cleaned.substr(text_begin, packed.text_begin((int) i_end) - text_begin);
+        for (size_t i = i_begin; i < i_end; ++i) {
+            transcript_token token = packed.tokens[i];
+            token.t0 = (int32_t) std::lround((job.source_time(token.t0 * 0.01) - segment.t_offset) * 100);
+            token.t1 = (int32_t) std::lround((job.source_time(token.t1 * 0.01) - segment.t_offset) * 100);
+            token.text_end -= text_begin;
+            segment.tokens.push_back(token);
+        }
+
+        i_begin = i_end;
+    }
+}
+
+// True if a word of segment, or a pair of adjacent words since the target may be split over two, has a
+// similarity() to the target of at least threshold. An exact match counts too.
+static bool segment_near_target(const transcript_segment & segment, const std::string & target, float threshold) {
+    bool near = segment.cleaned.find(target) != std::string::npos;
+    std::string prev;
+    transcript_segment_for_each_word(segment, [&](const std::string & word, double /*t_word*/) {
+        near = near ||
+            similarity(word, target) >= threshold ||
+            (!prev.empty() && similarity(prev + word, target) >= threshold);
+        prev = word;
+    });
+    return near;
+}
+
+//
+// transcribe_pool
+//
+
+transcribe_pool::~transcribe_pool() {
+    stop();
+}
+
+void transcribe_pool::start(struct whisper_context * ctx, const std::vector<struct whisper_state *> & states, const transcribe_pool_params & params,
+                            const std::vector<struct whisper_state *> & screen_states) {
+    this->ctx    = ctx;
+    this->params = params;
+
+    // a model that isn't multilingual runs without detecting the language, there is nothing to save
+    this->params.pin_language = params.pin_language && whisper_is_multilingual(ctx);
+    lang_p_sum.assign(whisper_lang_max_id() + 1, 0.0f);
+    n_lang_unsure = 0;
+
+    const int n_states = (int) states.size();
+    for (int i = 0; i < n_states; ++i) {
+        whisper_full_params state_params = params.wparams;
+        state_params.n_threads = std::max(1, params.n_threads / n_states + (i < params.n_threads % n_states ? 1 : 0));
+        struct whisper_state * screen_state = params.screen_ctx && i < (int) screen_states.size() ? screen_states[i] : nullptr;
+        workers.emplace_back(&transcribe_pool::worker, this, states[i], screen_state, state_params);
+    }
+}
+
+int64_t transcribe_pool::submit(transcribe_job && job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    job.seq = n_submitted++;
+    queue.push_back(std::move(job));
+    cv_queue.notify_one();
+    return n_submitted - 1;
+}
+
+bool transcribe_pool::next(transcribe_job & job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv_done.wait(lock, [this] { return is_cancelled || next_seq == n_submitted || next_seq > hit_seq || done.count(next_seq) > 0; });
+    if (is_cancelled || next_seq == n_submitted || next_seq > hit_seq) {
+        return false;
+    }
+
+    auto it = done.find(next_seq);
+    job = std::move(it->second);
+    done.erase(it);
+    ++next_seq;
+
+    return true;
+}
+
+bool transcribe_pool::ready() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return is_cancelled || next_seq == n_submitted || next_seq > hit_seq || done.count(next_seq) > 0;
+}
+
+void transcribe_pool::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    is_cancelled = true;
+    queue.clear();
+    done.clear();
+    cv_done.notify_all();
+}
+
+void transcribe_pool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_cancelled = true;
+        is_stopping  = true;
+        queue.clear();
+        cv_queue.notify_all();
+        cv_done.notify_all();
+    }
+    for (std::thread & worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+transcribe_pool_stats transcribe_pool::get_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void transcribe_pool::worker(struct whisper_state * state, struct whisper_state * screen_state, whisper_full_params wparams) {
+    worker_context wctx;
+    wctx.pool = this;
+    wparams.abort_callback                 = abort_job;
+    wparams.abort_callback_user_data       = &wctx;
+    wparams.new_segment_callback           = on_new_segment;
+    wparams.new_segment_callback_user_data = &wctx;
+
+    while (true) {
+        transcribe_job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_queue.wait(lock, [this] { return is_stopping || !queue.empty(); });
+            if (is_stopping) {
+                return;
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        wctx.job   = &job;
+        wctx.found = false;
+        transcribe_pool_stats job_stats;
+        if (params.pin_language && pinned_lang < 0 && !lang_given_up) {
+            // detecting with the screening model is cheaper, if it is multilingual
+            if (screen_state && whisper_is_multilingual(params.screen_ctx)) {
+                detect_language(params.screen_ctx, screen_state, wparams.n_threads, job, job_stats);
+            } else {
+                detect_language(ctx, state, wparams.n_threads, job, job_stats);
+            }
+        } else if (params.pin_language && pinned_lang >= 0) {
+            job_stats.n_lang_pinned = 1;
+        }
+        if (screen_state == nullptr || screen(screen_state, wparams, job, job_stats)) {
+            if (params.align) {
+                align(state, wparams, job, job_stats);
+            } else {
+                run(state, wparams, job, job_stats);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.n_jobs        += job_stats.n_jobs;
+        stats.n_reruns      += job_stats.n_reruns;
+        stats.n_frames      += job_stats.n_frames;
+        stats.n_frames_full += job_stats.n_frames_full;
+        stats.t_whisper_s   += job_stats.t_whisper_s;
+        stats.n_lang_detect   += job_stats.n_lang_detect;
+        stats.n_lang_pinned   += job_stats.n_lang_pinned;
+        stats.t_lang_detect_s += job_stats.t_lang_detect_s;
+        stats.n_align_decode  += job_stats.n_align_decode;
+        stats.n_greedy      += job_stats.n_greedy;
+        stats.n_escalated   += job_stats.n_escalated;
+        stats.n_screened    += job_stats.n_screened;
+        stats.n_confirmed   += job_stats.n_confirmed;
+        stats.t_screen_s    += job_stats.t_screen_s;
+        if (is_cancelled || job.seq > hit_seq) {
+            continue;
+        }
+        if (job.t_found >= 0 && job.seq < hit_seq) {
+            // later jobs can't hold the first occurrence, drop them
+            hit_seq = job.seq;
+            queue.erase(std::remove_if(queue.begin(), queue.end(),
+                [&](const transcribe_job & queued) { return queued.seq > job.seq; }), queue.end());
+            for (auto it = done.upper_bound(job.seq); it != done.end(); ) {
+                it = done.erase(it);
+            }
+        }
+        done.emplace(job.seq, std::move(job));
+        cv_done.notify_all();
+    }
+}
+
+bool transcribe_pool::abort_job(void * user_data) {
+    const worker_context * wctx = (const worker_context *) user_data;
+    return wctx->found || wctx->pool->is_cancelled || wctx->job->seq > wctx->pool->hit_seq;
+}
+
+// Segments are checked as whisper emits them, once the target is found the rest of the job is skipped
+void transcribe_pool::on_new_segment(struct whisper_context * /*ctx*/, struct whisper_state * state, int n_new, void * user_data) {
+    worker_context * wctx = (worker_context *) user_data;
+    transcribe_job & job = *wctx->job;
+    const transcribe_pool & pool = *wctx->pool;
+
+    const int n_segments = whisper_full_n_segments_from_state(state);
+    for (int k = n_segments - n_new; k < n_segments && !wctx->found; ++k) {
+        const size_t i_first = job.segments.size();
+        append_segment(pool.ctx, state, k, pool.params.vocab, job);
+        for (size_t i = i_first; i < job.segments.size() && job.t_found < 0; ++i) {
+            if (pool.params.fuzzy) {
+                job.t_found = transcript_segment_find_fuzzy(job.segments[i], *pool.params.fuzzy);
+            } else if (pool.params.matcher) {
+                job.t_found = transcript_segment_find(job.segments[i], *pool.params.matcher);
+            } else if (!pool.params.target.empty()) {
+                job.t_found = transcript_segment_find(job.segments[i], pool.params.target);
+            }
+        }
+        if (job.t_found >= 0) {
+            job.t_end  = std::min(job.t_end, job.source_time(whisper_full_get_segment_t1_from_state(state, k) * 0.01));
+            wctx->found = true;
+        }
+    }
+}
+
+void transcribe_pool::run(struct whisper_state * state, const whisper_full_params & wparams, transcribe_job & job, transcribe_pool_stats & job_stats) {
+    const worker_context * wctx = (const worker_context *) wparams.abort_callback_user_data;
+    const int n_audio_ctx = whisper_model_n_audio_ctx(ctx);
+
+    whisper_full_params job_params = wparams;
+    if (pinned_lang >= 0) {
+        job_params.language = whisper_lang_str(pinned_lang);
+    }
+    if (params.escalate_p > 0 && wparams.strategy == WHISPER_SAMPLING_BEAM_SEARCH) {
+        job_params.strategy = WHISPER_SAMPLING_GREEDY;
+        job_stats.n_greedy  = 1;
+    }
+    if (params.adaptive_audio_ctx) {
+        const int n_frames = (int) (job.samples.size() / k_samples_per_frame) + k_audio_ctx_margin;
+        job_params.audio_ctx = n_frames < n_audio_ctx ? n_frames : 0;
+    }
+
+    const auto t_start = std::chrono::steady_clock::now();
+    job_stats.n_jobs        = 1;
+    job_stats.n_frames_full = n_audio_ctx;
+
+    int ret = 0;
+    while (true) {
+        job.segments.clear();
+        job.t_found = -1.0;
+        job.t_end   = job.source_time((double) job.samples.size() / WHISPER_SAMPLE_RATE);
+        job_stats.n_frames += job_params.audio_ctx > 0 ? job_params.audio_ctx : n_audio_ctx;
+
+        ret = whisper_full_with_state(ctx, state, job_params, job.samples.data(), (int) job.samples.size());
+
+        if (ret != 0 || wctx->found) {
+            break;
+        }
+
+        // quality guard: a reduced context that yields nothing is retried at full context
+        bool has_tokens = false;
+        for (const transcript_segment & segment : job.segments) {
+            has_tokens = has_tokens || !segment.tokens.empty();
+        }
+        if (!has_tokens && job_params.audio_ctx != 0) {
+            job_params.audio_ctx = 0;
+            job_stats.n_reruns++;
+            continue;
+        }
+
+        // adaptive beam: a greedy transcript that is unsure or nearly has the target is decoded again with beam search
+        if (job_params.strategy != wparams.strategy && !is_confident(job)) {
+            job_params.strategy = wparams.strategy;
+            job_stats.n_escalated++;
+            continue;
+        }
+
+        break;
+    }
+
+    job_stats.t_whisper_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    // an early exit on a hit aborts whisper_full(), the segments up to the hit are complete
+    job.ok = ret == 0 || wctx->found;
+    if (!job.ok && !abort_job(wparams.abort_callback_user_data)) {
+        fprintf(stderr, "Error: Failed to process segment.\n");
+    }
+}
+
+// Detect the language on job and pin it if confident. The job is then run with that language,
+// so detecting costs no more than the detection whisper_full() runs with "auto"
+// Without a confident detection the most likely language is pinned after k_pin_language_max_unsure jobs
+void transcribe_pool::detect_language(struct whisper_context * lang_ctx, struct whisper_state * lang_state, int n_threads, const transcribe_job & job, transcribe_pool_stats & job_stats) {
+    const auto t_start = std::chrono::steady_clock::now();
+
+    std::vector<float> lang_probs(whisper_lang_max_id() + 1, 0.0f);
+    int lang = -1;
+    if (whisper_pcm_to_mel_with_state(lang_ctx, lang_state, job.samples.data(), (int) job.samples.size(), n_threads) == 0) {
+        lang = whisper_lang_auto_detect_with_state(lang_ctx, lang_state, 0, n_threads, lang_probs.data());
+    }
+
+    job_stats.n_lang_detect   = 1;
+    job_stats.t_lang_detect_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    if (lang >= 0 && lang_probs[lang] >= k_pin_language_p) {
+        int none = -1;
+        pinned_lang.compare_exchange_strong(none, lang);
+        return;
+    }
+
+    // detecting on every job would cost more than it saves: after a few unsure jobs pin the language
+    // most likely over all of them, or stop trying if detection failed on all of them
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < lang_probs.size(); ++i) {
+        lang_p_sum[i] += lang_probs[i];
+    }
+    if (++n_lang_unsure < k_pin_language_max_unsure) {
+        return;
+    }
+    const int lang_best = (int) (std::max_element(lang_p_sum.begin(), lang_p_sum.end()) - lang_p_sum.begin());
+    if (lang_p_sum[lang_best] > 0.0f) {
+        int none = -1;
+        pinned_lang.compare_exchange_strong(none, lang_best);
+    } else {
+        lang_given_up = true;
+    }
+}
+
+// Every 30 s window of the job is encoded once and scored at starts spread over the window, the peaks of the
+// decoder's timestamp logits after the prompt and the start of every packed piece in the window. A few decoder
+// steps per start replace the transcription of the job
+void transcribe_pool::align(struct whisper_state * state, const whisper_full_params & wparams, transcribe_job & job, transcribe_pool_stats & job_stats) {
+    const int n_threads   = wparams.n_threads;
+    const int n_audio_ctx = whisper_model_n_audio_ctx(ctx);
+    const bool multilingual = whisper_is_multilingual(ctx) != 0;
+
+    // jobs can be longer than a window, e.g. speech held back by the VAD or with --no-pack
+    const int64_t n_window  = (int64_t) n_audio_ctx * k_samples_per_frame;
+    const int64_t n_windows = std::max<int64_t>(1, ((int64_t) job.samples.size() + n_window - 1) / n_window);
+
+    const auto t_start = std::chrono::steady_clock::now();
+    job_stats.n_jobs        = 1;
+    job_stats.n_frames      = n_audio_ctx * n_windows;
+    job_stats.n_frames_full = n_audio_ctx * n_windows;
+
+    job.segments.clear();
+    job.t_found = -1.0;
+    job.t_end   = job.source_time((double) job.samples.size() / WHISPER_SAMPLE_RATE);
+
+    int lang = pinned_lang;
+    if (lang < 0 && wparams.language && strcmp(wparams.language, "auto") != 0) {
+        lang = whisper_lang_id(wparams.language);
+    }
+
+    int  n_decode = 0;
+    bool ok       = true;
+    bool aborted  = false;
+    std::vector<int> candidates;
+    for (int64_t w = 0; ok && job.t_found < 0 && w < n_windows && !(aborted = abort_job(wparams.abort_callback_user_data)); ++w) {
+        const int64_t offset    = w * n_window;
+        const int     n_samples = (int) std::min(n_window, (int64_t) job.samples.size() - offset);
+
+        ok = whisper_pcm_to_mel_with_state(ctx, state, job.samples.data() + offset, n_samples, n_threads) == 0;
+        if (ok && multilingual && lang < 0) {
+            // detecting the language encodes the window too
+            lang = whisper_lang_auto_detect_with_state(ctx, state, 0, n_threads, nullptr);
+            ok = lang >= 0;
+        } else if (ok) {
+            ok = whisper_encode_with_state(ctx, state, 0, n_threads) == 0;
+        }
+
+        std::vector<whisper_token> prompt = { whisper_token_sot(ctx) };
+        if (multilingual) {
+            prompt.push_back(whisper_token_lang(ctx, lang));
+            prompt.push_back(whisper_token_transcribe(ctx));
+        }
+        n_decode++;
+        ok = ok && whisper_decode_with_state(ctx, state, prompt.data(), (int) prompt.size(), 0, n_threads) == 0;
+        if (!ok) {
+            break;
+        }
+
+        const int n_ts = std::min(n_audio_ctx, n_samples / k_samples_per_frame);
+        keyword_align_candidates(ctx, state, n_ts, k_align_spacing, candidates);
+        for (const transcribe_piece & piece : job.pieces) {
+            const int64_t ts = (piece.packed - offset) / k_samples_per_frame;
+            if (piece.packed >= offset && ts <= n_ts && std::find(candidates.begin(), candidates.end(), ts) == candidates.end()) {
+                candidates.push_back((int) ts);
+            }
+        }
+
+        float best    = -INFINITY;
+        int   ts_best = -1;
+        for (int ts : candidates) {
+            const float score = keyword_align_score(ctx, state, *params.align, (int) prompt.size(), ts, n_threads, n_decode);
+            if (score > best) {
+                best    = score;
+                ts_best = ts;
+            }
+        }
+        if (best >= params.align->threshold) {
+            job.t_found = job.source_time((double) (offset + (int64_t) ts_best * k_samples_per_frame) / WHISPER_SAMPLE_RATE);
+            job.t_end   = job.t_found;
+        }
+    }
+
+    job_stats.n_align_decode = n_decode;
+    job_stats.t_whisper_s    = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    job.ok = ok && !aborted;
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to align segment.\n");
+    }
+}
+
+bool transcribe_pool::is_confident(const transcribe_job & job) const {
+    for (const transcript_segment & segment : job.segments) {
+        if (segment.tokens.empty()) {
+            continue;
+        }
+        float p_sum = 0.0f;
+        for (const transcript_token & token : segment.tokens) {
+            p_sum += token.p;
+        }
+        if (p_sum < params.escalate_p * segment.tokens.size()) {
+            return false;
+        }
+        if (!params.target.empty() && segment_near_target(segment, params.target, params.escalate_similarity)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Screen job with the small model. Returns true if its transcript comes close enough to the target
+// for the main model to transcribe it, otherwise job holds the screening transcript
+bool transcribe_pool::screen(struct whisper_state * screen_state, const whisper_full_params & wparams, transcribe_job & job, transcribe_pool_stats & job_stats) {
+    whisper_full_params screen_params = params.screen_wparams;
+    screen_params.n_threads                = wparams.n_threads;
+    screen_params.abort_callback           = wparams.abort_callback;
+    screen_params.abort_callback_user_data = wparams.abort_callback_user_data;
+    if (pinned_lang >= 0) {
+        screen_params.language = whisper_lang_str(pinned_lang);
+    }
+
+    const auto t_start = std::chrono::steady_clock::now();
+    const int ret = whisper_full_with_state(params.screen_ctx, screen_state, screen_params, job.samples.data(), (int) job.samples.size());
+    job_stats.n_screened = 1;
+
+    job.segments.clear();
+    job.t_found = -1.0;
+    job.t_end   = job.source_time((double) job.samples.size() / WHISPER_SAMPLE_RATE);
+
+    if (ret != 0 && abort_job(wparams.abort_callback_user_data)) {
+        job_stats.t_screen_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+        job.ok = false;
+        return false;
+    }
+
+    // A failed screening pass leaves the job to the main model
+    bool candidate = ret != 0;
+    const int n_segments = ret == 0 ? whisper_full_n_segments_from_state(screen_state) : 0;
+    for (int k = 0; k < n_segments; ++k) {
+        const size_t i_first = job.segments.size();
+        append_segment(params.screen_ctx, screen_state, k, params.screen_vocab, job);
+        for (size_t i = i_first; i < job.segments.size(); ++i) {
+            candidate = candidate || segment_near_target(job.segments[i], params.target, params.screen_threshold);
+        }
+    }
+
+    job_stats.t_screen_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    if (candidate) {
+        job_stats.n_confirmed = 1;
+        return true;
+    }
+
+    job.ok = true;
+    return false;
+}
@@ -0,0 +1,150 @@
+#include "transcript.h"
+#include "cleaned-vocab.h"
+#include "fuzzy-match.h"
+
+#include <algorithm>
+#include <cctype>
+
+std::string clean_word(const std::string & word) {
+    std::string cleaned;
+    cleaned.reserve(word.length());
+    for (unsigned char c : word) {
+        if (std::isalnum(c)) {
+            cleaned += (char)std::tolower(c);
+        }
+    }
+    return cleaned;
+}
+
+void append_cleaned_word(const char * token_text, std::string & accumulated) {
+    if (!token_text) return;
+    for (size_t i = 0; token_text[i] != '\0'; ++i) {
+        unsigned char c = (unsigned char)token_text[i];
+        if (std::isalnum(c)) {
+            accumulated += (char)std::tolower(c);
+        }
+    }
+}
+
+int transcript_segment::token_at(size_t pos) const {
+    auto it = std::upper_bound(tokens.begin(), tokens.end(), (uint32_t) pos,
+        [](uint32_t p, const transcript_token & token) { return p < token.text_end; });
+    return (int) (it - tokens.begin());
+}
+
+// state == nullptr reads the results from the default state of ctx
+void transcript_segment_from_whisper(
+        struct whisper_context * ctx,
+          struct whisper_state * state,
+                           int   i_segment,
+                        double   t_offset,
+            transcript_segment & segment,
+           const cleaned_vocab * vocab) {
+    segment.t_offset = t_offset;
+    segment.cleaned.clear();
+    segment.tokens.clear();
+
+    const whisper_token token_beg = whisper_token_beg(ctx);
+    const int n_tokens = state ? whisper_full_n_tokens_from_state(state, i_segment) : whisper_full_n_tokens(ctx, i_segment);
+    segment.tokens.reserve(n_tokens);
+
+    for (int i = 0; i < n_tokens; ++i) {
+        const whisper_token_data data = state ?
+            whisper_full_get_token_data_from_state(state, i_segment, i) :
+            whisper_full_get_token_data(ctx, i_segment, i);
+        if (data.id >= token_beg) continue;
+
+        bool word_start;
+        if (vocab && data.id >= 0 && data.id < vocab->n_vocab()) {
+            segment.cleaned.append(vocab->text(data.id), vocab->size(data.id));
+            word_start = vocab->word_start[data.id] != 0;
+        } else {
+            const char * token_text = state ?
+                whisper_full_get_token_text_from_state(ctx, state, i_segment, i) :
+                whisper_full_get_token_text(ctx, i_segment, i);
+            append_cleaned_word(token_text, segment.cleaned);
+            word_start = token_text && token_text[0] == ' ';
+        }
+
+        transcript_token token;
+        token.id       = data.id;
+        token.t0       = (int32_t) data.t0;
+        token.t1       = (int32_t) data.t1;
+        token.p        = data.p;
+        token.text_end = (uint32_t) segment.cleaned.size();
+        token.flags    = word_start ? TRANSCRIPT_TOKEN_WORD_START : 0;
+        segment.tokens.push_back(token);
+    }
+}
+
+double transcript_segment_find(const transcript_segment & segment, const std::string & target) {
+    const size_t pos = segment.cleaned.find(target);
+    if (pos == std::string::npos) {
+        return -1.0;
+    }
+    return segment.token_time(segment.token_at(pos));
+}
+
+double transcript_segment_find(const transcript_segment & segment, const token_matcher & matcher) {
+    int state = 0;
+    for (int i = 0; i < (int) segment.tokens.size(); ++i) {
+        bool hit = false;
+        state = matcher.step(state, segment.tokens[i].id, hit);
+        if (!hit) {
+            continue;
+        }
+        // no occurrence ended before token i, so the first one starts less than a word before its text
+        const uint32_t begin = segment.text_begin(i);
+        const size_t   from  = begin + 1 > matcher.word.size() ? begin + 1 - matcher.word.size() : 0;
+        const size_t   pos   = segment.cleaned.find(matcher.word, from);
+        if (pos != std::string::npos) {
+            return segment.token_time(segment.token_at(pos));
+        }
+    }
+    return -1.0;
+}
+
+// First approximate occurrence in segment starting in [t_from, t_to), t_from < 0 and t_to < 0 mean no bound
+static double transcript_find_fuzzy_in(const transcript_segment & segment, const fuzzy_matcher & matcher, double t_from, double t_to) {
+    double t_first = -1.0;
+    matcher.find_all(segment.cleaned, [&](size_t start, size_t /*end*/, int /*n_edits*/) {
+        const double t = segment.token_time(segment.token_at(start));
+        if (t_first < 0 && t >= t_from && (t_to < 0 || t < t_to)) {
+            t_first = t;
+        }
+    });
+    return t_first;
+}
+
+double transcript_find(const transcript & tr, const std::string & target, double t_from, double t_to) {
+    for (const transcript_segment & segment : tr.segments) {
+        if (t_to >= 0 && segment.t_offset >= t_to) {
+            continue;
+        }
+        // a segment may start before t_from and still hold words inside the window
+        for (size_t pos = segment.cleaned.find(target); pos != std::string::npos; pos = segment.cleaned.find(target, pos + 1)) {
+            const double t = segment.token_time(segment.token_at(pos));
+            if (t >= t_from && (t_to < 0 || t < t_to)) {
+                return t;
+            }
+        }
+    }
+    return -1.0;
+}
+
+double transcript_segment_find_fuzzy(const transcript_segment & segment, const fuzzy_matcher & matcher) {
+    return transcript_find_fuzzy_in(segment, matcher, -1.0, -1.0);
+}
+
+double transcript_find_fuzzy(const transcript & tr, const fuzzy_matcher & matcher, double t_from, double t_to) {
+    for (const transcript_segment & segment : tr.segments) {
+        if (t_to >= 0 && segment.t_offset >= t_to) {
+            continue;
+        }
+        const double t = transcript_find_fuzzy_in(segment, matcher, t_from, t_to);
+        if (t >= 0) {
+            return t;
+        }
+    }
+    return -1.0;
+}
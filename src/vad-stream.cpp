@@ -0,0 +1,63 @@
+#include "vad-stream.h"
+
+#include <algorithm>
+
+// Speech held back for longer than this is emitted anyway, split at the end of the block
+static const int64_t k_max_held_back = 30 * WHISPER_SAMPLE_RATE;
+
+vad_stream::vad_stream(struct whisper_vad_context * vctx, const whisper_vad_params & params, int64_t start) :
+    vctx(vctx), params(params), window_start(start) {
+}
+
+void vad_stream::push(const float * data, size_t n, std::vector<speech_segment> & out) {
+    window.insert(window.end(), data, data + n);
+    process(false, out);
+}
+
+void vad_stream::flush(std::vector<speech_segment> & out) {
+    if (!window.empty()) {
+        process(true, out);
+    }
+}
+
+void vad_stream::process(bool final, std::vector<speech_segment> & out) {
+    const int64_t n_window = (int64_t) window.size();
+
+    // A segment ending this close to the end of the window may still continue: the VAD only closes
+    // a segment after min_silence_duration_ms of silence and pads it by speech_pad_ms
+    const int64_t guard = (int64_t) (params.min_silence_duration_ms + params.speech_pad_ms) * WHISPER_SAMPLE_RATE / 1000 + 512;
+    const int64_t open_from = final ? n_window : std::max<int64_t>(0, n_window - guard);
+
+    // hold back the undecided tail by default
+    int64_t keep_from = open_from;
+
+    struct whisper_vad_segments * segments = whisper_vad_segments_from_samples(vctx, params, window.data(), (int) n_window);
+    const int n_segments = segments ? whisper_vad_segments_n_segments(segments) : 0;
+    for (int j = 0; j < n_segments; ++j) {
+        // segment times are in centiseconds
+        const int64_t s0 = std::max<int64_t>(0,        (int64_t) (whisper_vad_segments_get_segment_t0(segments, j) * WHISPER_SAMPLE_RATE / 100));
+        const int64_t s1 = std::min<int64_t>(n_window, (int64_t) (whisper_vad_segments_get_segment_t1(segments, j) * WHISPER_SAMPLE_RATE / 100));
+        if (s1 <= s0) {
+            continue;
+        }
+
+        if (!final && s1 >= open_from && n_window - s0 <= k_max_held_back) {
+            keep_from = std::min(keep_from, s0);
+            break;
+        }
+
+        speech_segment segment;
+        segment.start = window_start + s0;
+        segment.samples.assign(window.begin() + s0, window.begin() + s1);
+        out.push_back(std::move(segment));
+
+        keep_from = std::max(keep_from, s1);
+    }
+    if (segments) {
+        whisper_vad_free_segments(segments);
+    }
+
+    keep_from = std::min(keep_from, n_window);
+    window.erase(window.begin(), window.begin() + keep_from);
+    window_start += keep_from;
+}
@@ -0,0 +1,472 @@
+#include "word-index.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char     k_word_index_magic[8] = { 'D', 'W', 'I', 'D', 'X', 0, 0, 0 };
+static const uint32_t k_word_index_version  = 2;
+
+struct word_index_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t n_files;
+    uint64_t n_terms;
+    uint64_t files_offset;    // word_index_file[n_files]
+    uint64_t terms_offset;    // word_index_term[n_terms], sorted by term
+    uint64_t postings_offset; // varint encoded postings of all terms, (file, time, position) deltas
+    uint64_t strings_offset;  // file paths and terms
+    uint64_t reserved;
+};
+
+struct word_index_file {
+    uint64_t path_offset; // relative to strings_offset
+    uint32_t path_len;
+    uint32_t reserved;
+};
+
+struct word_index_term {
+    uint64_t term_offset; // relative to strings_offset
+    uint32_t term_len;
+    uint32_t n_postings;
+    uint64_t postings_offset; // relative to postings_offset
+    uint64_t postings_len;
+};
+
+static_assert(sizeof(word_index_header) == 64, "word_index_header must be 64 bytes");
+static_assert(sizeof(word_index_file)   == 16, "word_index_file must be 16 bytes");
+static_assert(sizeof(word_index_term)   == 32, "word_index_term must be 32 bytes");
+
+static void varint_write(std::vector<uint8_t> & out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t) value);
+}
+
+// Stops at end, a varint cut short by end reads as its low bits
+static uint32_t varint_read(const uint8_t *& p, const uint8_t * end) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        const uint8_t b = *p++;
+        value |= (uint32_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            break;
+        }
+    }
+    return value;
+}
+
+//
+// word_index_builder
+//
+
+uint32_t word_index_builder::add_file(const std::string & path) {
+    files.push_back(path);
+    n_words.push_back(0);
+    return (uint32_t) files.size() - 1;
+}
+
+void word_index_builder::add_transcript(uint32_t file_id, const transcript & tr) {
+    for (const transcript_segment & segment : tr.segments) {
+        transcript_segment_for_each_word(segment, [&](const std::string & word, double t) {
+            postings[word].push_back({ file_id, (uint32_t) std::max(0.0, t * 100.0 + 0.5), n_words[file_id]++ });
+        });
+        // a position is skipped between segments, a match never runs from one segment into the next
+        ++n_words[file_id];
+    }
+}
+
+bool word_index_builder::write(const std::string & path) const {
+    std::vector<word_index_file> file_table;
+    std::vector<word_index_term> term_table;
+    std::vector<uint8_t> postings_data;
+    std::string strings;
+
+    for (const std::string & file : files) {
+        word_index_file entry;
+        entry.path_offset = strings.size();
+        entry.path_len    = (uint32_t) file.size();
+        entry.reserved    = 0;
+        file_table.push_back(entry);
+        strings += file;
+    }
+
+    for (const auto & kv : postings) {
+        std::vector<word_posting> sorted = kv.second;
+        std::sort(sorted.begin(), sorted.end(), [](const word_posting & a, const word_posting & b) {
+            return a.file_id != b.file_id ? a.file_id < b.file_id : a.pos < b.pos;
+        });
+
+        word_index_term entry;
+        entry.term_offset     = strings.size();
+        entry.term_len        = (uint32_t) kv.first.size();
+        entry.n_postings      = (uint32_t) sorted.size();
+        entry.postings_offset = postings_data.size();
+        strings += kv.first;
+
+        // file ids are delta encoded, times and positions are delta encoded within the same file
+        // the time of a word may precede the one of the previous word, its delta wraps around
+        uint32_t prev_file = 0;
+        uint32_t prev_t    = 0;
+        uint32_t prev_pos  = 0;
+        for (const word_posting & posting : sorted) {
+            if (posting.file_id != prev_file) {
+                prev_t   = 0;
+                prev_pos = 0;
+            }
+            varint_write(postings_data, posting.file_id - prev_file);
+            varint_write(postings_data, posting.t - prev_t);
+            varint_write(postings_data, posting.pos - prev_pos);
+            prev_file = posting.file_id;
+            prev_t    = posting.t;
+            prev_pos  = posting.pos;
+        }
+        entry.postings_len = postings_data.size() - entry.postings_offset;
+        term_table.push_back(entry);
+    }
+
+    word_index_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, k_word_index_magic, sizeof(hdr.magic));
+    hdr.version         = k_word_index_version;
+    hdr.n_files         = (uint32_t) file_table.size();
+    hdr.n_terms         = term_table.size();
+    hdr.files_offset    = sizeof(hdr);
+    hdr.terms_offset    = hdr.files_offset + file_table.size() * sizeof(word_index_file);
+    hdr.postings_offset = hdr.terms_offset + term_table.size() * sizeof(word_index_term);
+    hdr.strings_offset  = hdr.postings_offset + postings_data.size();
+
+    const std::string path_tmp = path + ".tmp." + std::to_string(getpid());
+    FILE * file = fopen(path_tmp.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "%s: failed to create %s\n", __func__, path_tmp.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+        fwrite(file_table.data(),    sizeof(word_index_file), file_table.size(), file) == file_table.size() &&
+        fwrite(term_table.data(),    sizeof(word_index_term), term_table.size(), file) == term_table.size() &&
+        fwrite(postings_data.data(), 1, postings_data.size(), file) == postings_data.size() &&
+        fwrite(strings.data(),       1, strings.size(),       file) == strings.size();
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || rename(path_tmp.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "%s: failed to write %s\n", __func__, path.c_str());
+        remove(path_tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+//
+// word_index
+//
+
+word_index::~word_index() {
+    close();
+}
+
+// True if the n entries of elem_size bytes at offset fit in [offset, end), without overflowing
+static bool word_index_range_ok(uint64_t offset, uint64_t n, uint64_t elem_size, uint64_t end) {
+    return offset <= end && n <= (end - offset) / elem_size;
+}
+
+// Check every offset and count of a mapped index before it is used, so a truncated or corrupt file
+// is rejected instead of read out of bounds
+static bool word_index_validate(const uint8_t * data, size_t size) {
+    const word_index_header * hdr = (const word_index_header *) data;
+    if (memcmp(hdr->magic, k_word_index_magic, sizeof(hdr->magic)) != 0 ||
+        hdr->version != k_word_index_version) {
+        return false;
+    }
+
+    // sections: header, files, terms, postings, strings, the tables must stay 8-byte aligned
+    if (hdr->files_offset < sizeof(word_index_header) || hdr->files_offset % 8 != 0 || hdr->terms_offset % 8 != 0 ||
+        hdr->postings_offset > hdr->strings_offset || hdr->strings_offset > size ||
+        !word_index_range_ok(hdr->files_offset, hdr->n_files, sizeof(word_index_file), hdr->terms_offset) ||
+        !word_index_range_ok(hdr->terms_offset, hdr->n_terms, sizeof(word_index_term), hdr->postings_offset)) {
+        return false;
+    }
+
+    const uint64_t postings_size = hdr->strings_offset - hdr->postings_offset;
+    const uint64_t strings_size  = size - hdr->strings_offset;
+
+    const word_index_file * files = (const word_index_file *) (data + hdr->files_offset);
+    for (uint32_t i = 0; i < hdr->n_files; ++i) {
+        if (!word_index_range_ok(files[i].path_offset, files[i].path_len, 1, strings_size)) {
+            return false;
+        }
+    }
+
+    // each posting is three varints of at least one byte
+    const word_index_term * terms = (const word_index_term *) (data + hdr->terms_offset);
+    for (uint64_t i = 0; i < hdr->n_terms; ++i) {
+        if (!word_index_range_ok(terms[i].term_offset, terms[i].term_len, 1, strings_size) ||
+            !word_index_range_ok(terms[i].postings_offset, terms[i].postings_len, 1, postings_size) ||
+            terms[i].n_postings > terms[i].postings_len / 3) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool word_index::open(const std::string & path) {
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "%s: failed to open %s\n", __func__, path.c_str());
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || (size_t) sb.st_size < sizeof(word_index_header)) {
+        fprintf(stderr, "%s: invalid index %s\n", __func__, path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    void * addr = mmap(nullptr, (size_t) sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "%s: failed to map %s\n", __func__, path.c_str());
+        return false;
+    }
+
+    if (!word_index_validate((const uint8_t *) addr, (size_t) sb.st_size)) {
+        fprintf(stderr, "%s: invalid index %s\n", __func__, path.c_str());
+        munmap(addr, (size_t) sb.st_size);
+        return false;
+    }
+
+    data = (const uint8_t *) addr;
+    size = (size_t) sb.st_size;
+
+    return true;
+}
+
+void word_index::close() {
+    if (data) {
+        munmap((void *) data, size);
+    }
+    data = nullptr;
+    size = 0;
+}
+
+uint32_t word_index::n_files() const {
+    return data ? ((const word_index_header *) data)->n_files : 0;
+}
+
+std::string word_index::file_path(uint32_t file_id) const {
+    const word_index_header * hdr = (const word_index_header *) data;
+    const word_index_file * files = (const word_index_file *) (data + hdr->files_offset);
+
+    return std::string((const char *) data + hdr->strings_offset + files[file_id].path_offset, files[file_id].path_len);
+}
+
+// Append the postings of term to result
+static void word_index_read_postings(const uint8_t * data, const word_index_term & term, std::vector<word_posting> & result) {
+    const word_index_header * hdr = (const word_index_header *) data;
+
+    // the range was checked by open(), the file ids are checked here since they're only known once decoded
+    const uint8_t * p   = data + hdr->postings_offset + term.postings_offset;
+    const uint8_t * end = p + term.postings_len;
+    uint32_t file_id = 0;
+    uint32_t t       = 0;
+    uint32_t pos     = 0;
+    for (uint32_t i = 0; i < term.n_postings && p < end; ++i) {
+        const uint32_t file_delta = varint_read(p, end);
+        if (file_delta != 0) {
+            t   = 0;
+            pos = 0;
+        }
+        file_id += file_delta;
+        t       += varint_read(p, end);
+        pos     += varint_read(p, end);
+        if (file_id >= hdr->n_files) {
+            break;
+        }
+        result.push_back({ file_id, t, pos });
+    }
+}
+
+// First term of the sorted term table not less than word
+static const word_index_term * word_index_lower_bound(const uint8_t * data, const std::string & word) {
+    const word_index_header * hdr = (const word_index_header *) data;
+    const word_index_term * terms = (const word_index_term *) (data + hdr->terms_offset);
+    const char * strings = (const char *) data + hdr->strings_offset;
+
+    auto compare = [&](const word_index_term & term, const std::string & w) {
+        const int cmp = memcmp(strings + term.term_offset, w.data(), std::min<size_t>(term.term_len, w.size()));
+        return cmp != 0 ? cmp < 0 : term.term_len < w.size();
+    };
+    return std::lower_bound(terms, terms + hdr->n_terms, word, compare);
+}
+
+// The term equal to word, nullptr if there is none
+static const word_index_term * word_index_find_term(const uint8_t * data, const std::string & word) {
+    const word_index_header * hdr = (const word_index_header *) data;
+    const word_index_term * terms = (const word_index_term *) (data + hdr->terms_offset);
+    const char * strings = (const char *) data + hdr->strings_offset;
+
+    const word_index_term * it = word_index_lower_bound(data, word);
+    if (it == terms + hdr->n_terms || it->term_len != word.size() ||
+        memcmp(strings + it->term_offset, word.data(), word.size()) != 0) {
+        return nullptr;
+    }
+    return it;
+}
+
+std::vector<word_posting> word_index::lookup(const std::string & word) const {
+    std::vector<word_posting> result;
+    if (!data) {
+        return result;
+    }
+
+    const word_index_term * it = word_index_find_term(data, word);
+    if (!it) {
+        return result;
+    }
+
+    result.reserve(it->n_postings);
+    word_index_read_postings(data, *it, result);
+
+    return result;
+}
+
+std::vector<word_posting> word_index::find(const std::string & target) const {
+    std::vector<word_posting> result;
+    if (!data || target.empty()) {
+        return result;
+    }
+
+    const word_index_header * hdr = (const word_index_header *) data;
+    const word_index_term * terms = (const word_index_term *) (data + hdr->terms_offset);
+    const word_index_term * terms_end = terms + hdr->n_terms;
+    const char * strings = (const char *) data + hdr->strings_offset;
+    const size_t n = target.size();
+
+    auto has_prefix = [&](const word_index_term * term, const std::string & prefix) {
+        return term != terms_end && term->term_len >= prefix.size() &&
+            memcmp(strings + term->term_offset, prefix.data(), prefix.size()) == 0;
+    };
+
+    // viable[o]: target[o:] is spelled by whole terms followed by a term starting with the rest, judged on the term
+    // table alone so that only the postings of the spans that may be completed are read
+    std::vector<bool> viable(n + 1, false);
+    for (size_t o = n; o-- > 1; ) {
+        viable[o] = has_prefix(word_index_lower_bound(data, target.substr(o)), target.substr(o));
+        for (size_t len = 1; !viable[o] && o + len < n; ++len) {
+            viable[o] = viable[o + len] && word_index_find_term(data, target.substr(o, len)) != nullptr;
+        }
+    }
+
+    // spans[o]: the target's first o characters end a word, keyed by the (file, position) the next word must have,
+    // mapped to the posting of the word the span starts in
+    typedef std::pair<uint32_t, uint32_t> word_key;
+    std::vector<std::map<word_key, word_posting>> spans(n);
+
+    // one scan of the term table for the terms holding the whole target and the terms ending in a prefix of it
+    std::vector<word_posting> postings;
+    for (uint64_t i = 0; i < hdr->n_terms; ++i) {
+        const char * term = strings + terms[i].term_offset;
+        const size_t len  = terms[i].term_len;
+
+        postings.clear();
+        if (std::search(term, term + len, target.begin(), target.end()) != term + len) {
+            word_index_read_postings(data, terms[i], result);
+        }
+        for (size_t o = 1; o < n && o <= len; ++o) {
+            if (!viable[o] || memcmp(term + len - o, target.data(), o) != 0) {
+                continue;
+            }
+            if (postings.empty()) {
+                word_index_read_postings(data, terms[i], postings);
+            }
+            for (const word_posting & posting : postings) {
+                spans[o].emplace(word_key(posting.file_id, posting.pos + 1), posting);
+            }
+        }
+    }
+
+    // grow the spans word by word: a span of o characters continues with the term spelling the next characters,
+    // or ends in a term starting with the rest of the target
+    for (size_t o = 1; o < n; ++o) {
+        if (spans[o].empty()) {
+            continue;
+        }
+        auto extend = [&](const word_index_term & term, std::map<word_key, word_posting> * next) {
+            postings.clear();
+            word_index_read_postings(data, term, postings);
+            for (const word_posting & posting : postings) {
+                const auto it = spans[o].find(word_key(posting.file_id, posting.pos));
+                if (it == spans[o].end()) {
+                    continue;
+                }
+                if (next) {
+                    next->emplace(word_key(posting.file_id, posting.pos + 1), it->second);
+                } else {
+                    result.push_back(it->second);
+                }
+            }
+        };
+
+        for (size_t len = 1; o + len < n; ++len) {
+            const word_index_term * term = viable[o + len] ? word_index_find_term(data, target.substr(o, len)) : nullptr;
+            if (term) {
+                extend(*term, &spans[o + len]);
+            }
+        }
+
+        // the terms starting with the rest are a contiguous range of the sorted table
+        const std::string rest = target.substr(o);
+        for (const word_index_term * term = word_index_lower_bound(data, rest); has_prefix(term, rest); ++term) {
+            extend(*term, nullptr);
+        }
+        spans[o].clear();
+    }
+
+    // the hits starting in the same word are reported once
+    std::sort(result.begin(), result.end(), [](const word_posting & a, const word_posting & b) {
+        return a.file_id != b.file_id ? a.file_id < b.file_id : a.t != b.t ? a.t < b.t : a.pos < b.pos;
+    });
+    result.erase(std::unique(result.begin(), result.end(), [](const word_posting & a, const word_posting & b) {
+        return a.file_id == b.file_id && a.pos == b.pos;
+    }), result.end());
+
+    return result;
+}
+
+std::vector<word_posting> word_index::lookup_fuzzy(const fuzzy_matcher & matcher) const {
+    std::vector<word_posting> result;
+    if (!data) {
+        return result;
+    }
+
+    const word_index_header * hdr = (const word_index_header *) data;
+    const word_index_term * terms = (const word_index_term *) (data + hdr->terms_offset);
+    const char * strings = (const char *) data + hdr->strings_offset;
+
+    for (uint64_t i = 0; i < hdr->n_terms; ++i) {
+        bool found = false;
+        matcher.find_all(strings + terms[i].term_offset, terms[i].term_len, [&](size_t, size_t, int) { found = true; });
+        if (found) {
+            word_index_read_postings(data, terms[i], result);
+        }
+    }
+
+    std::sort(result.begin(), result.end(), [](const word_posting & a, const word_posting & b) {
+        return a.file_id != b.file_id ? a.file_id < b.file_id : a.t < b.t;
+    });
+
+    return result;
+}
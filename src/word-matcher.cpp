@@ -0,0 +1,60 @@
+#include "word-matcher.h"
+
+#include <deque>
+
+void word_matcher::init(const std::vector<std::string> & words) {
+    this->words = words;
+
+    // trie of the words, state 0 is the root
+    next.assign(k_n_chars, -1);
+    out.assign(1, -1);
+    for (size_t w = 0; w < words.size(); ++w) {
+        int state = 0;
+        for (char ch : words[w]) {
+            const int c = char_index(ch);
+            if (c < 0) {
+                break;
+            }
+            if (next[state * k_n_chars + c] < 0) {
+                next[state * k_n_chars + c] = (int) out.size();
+                next.insert(next.end(), k_n_chars, -1);
+                out.push_back(-1);
+            }
+            state = next[state * k_n_chars + c];
+        }
+        if (state > 0) {
+            out[state] = (int) w;
+        }
+    }
+
+    // breadth first, the failure state of every state is known before its children are completed
+    const int n_states = (int) out.size();
+    std::vector<int> fail(n_states, 0);
+    out_link.assign(n_states, 0);
+
+    std::deque<int> queue;
+    for (int c = 0; c < k_n_chars; ++c) {
+        int & child = next[c];
+        if (child < 0) {
+            child = 0;
+        } else {
+            queue.push_back(child);
+        }
+    }
+    while (!queue.empty()) {
+        const int state = queue.front();
+        queue.pop_front();
+
+        out_link[state] = out[fail[state]] >= 0 ? fail[state] : out_link[fail[state]];
+
+        for (int c = 0; c < k_n_chars; ++c) {
+            int & child = next[state * k_n_chars + c];
+            if (child < 0) {
+                child = next[fail[state] * k_n_chars + c];
+            } else {
+                fail[child] = next[fail[state] * k_n_chars + c];
+                queue.push_back(child);
+            }
+        }
+    }
+}